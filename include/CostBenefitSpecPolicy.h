@@ -0,0 +1,109 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "SpecializationPolicy.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallBitVector.h"
+
+#include <map>
+#include <set>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+  class Module;
+  class Instruction;
+}
+
+namespace previrt {
+  /* 
+   * This policy is actually a "functor" policy (i.e., it takes as
+   * argument another policy p that chooses the constant arguments).
+   *
+   * For each candidate copy, estimate the number of instructions of
+   * the callee that fold once the constant arguments are propagated
+   * (decided branches and switches, loads from constant globals,
+   * arithmetic on constants). The candidates are then admitted
+   * greedily by decreasing folded/size ratio while the growth of the
+   * module (size - folded for each new copy) stays under
+   * m_budget percent of the size of the module without its copies.
+   *
+   * The decisions are made for all the candidates of the module at
+   * once, the first time the policy is queried.
+   */
+  class CostBenefitSpecPolicy : public SpecializationPolicy {
+    
+    typedef std::pair<const llvm::Function*, const std::vector<PrevirtType>*> InterCall;
+    
+    std::unique_ptr<SpecializationPolicy> m_subpolicy;
+    llvm::Module& m_module;
+    const unsigned m_budget;
+
+    bool m_intra_ranked;
+    bool m_inter_ranked;
+    // admitted copies: callee with the arguments chosen by
+    // m_subpolicy. They are not keyed by call site because the
+    // specializer erases the call sites it rewrites.
+    typedef std::pair<const llvm::Function*, std::vector<llvm::Value*>> IntraCall;
+    std::set<IntraCall> m_intra_admitted;
+    std::map<InterCall, llvm::SmallBitVector> m_inter_admitted;
+
+    struct Candidate;
+    // Admit candidates greedily under the growth budget. Return the
+    // indexes of the admitted ones.
+    std::vector<unsigned> admit(std::vector<Candidate>& candidates) const;
+    
+    void rankIntra();
+    void rankInter(const ComponentInterface& interface);
+    
+  public:
+
+    CostBenefitSpecPolicy(llvm::Module &M,
+			  std::unique_ptr<SpecializationPolicy> subpolicy,
+			  unsigned budget);
+
+    virtual ~CostBenefitSpecPolicy();
+
+    virtual bool intraSpecializeOn(llvm::CallSite CS,
+				   std::vector<llvm::Value*>& marks) override;
+    
+    virtual bool interSpecializeOn(const llvm::Function& F,
+				   const std::vector<PrevirtType>& args,
+				   const ComponentInterface& interface,
+				   llvm::SmallBitVector& marks) override;
+  };
+
+} // end namespace
@@ -0,0 +1,195 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/*
+ * FlatInterface.h
+ *
+ * An alternative to the protobuf encoding of the interface (.iface)
+ * and rewrite (.rw) files that is read in place from a memory-mapped
+ * file: there is nothing to parse and no message to copy.
+ *
+ * A flat file is a header followed by tables of fixed-size
+ * little-endian records that refer to each other by index. Strings
+ * and types are stored once. Functions are sorted by name, and so
+ * are references and facts, so they are found by binary search.
+ * The files are converted to and from protobuf by occam-iface-convert.
+ */
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <string>
+
+namespace previrt
+{
+  class ComponentInterface;
+  class ComponentInterfaceTransform;
+  class PrevirtType;
+
+  namespace flat
+  {
+    using llvm::support::ulittle32_t;
+    using llvm::support::ulittle64_t;
+
+    const char Magic[8] = { 'O', 'C', 'C', 'A', 'M', 'F', 'I', '1' };
+    const uint32_t NoRewrite = ~0u;
+
+    // [offset, offset + size) in the table of strings
+    struct Str {
+      ulittle32_t offset;
+      ulittle32_t size;
+    };
+    // records [first, first + size) of a table
+    struct Range {
+      ulittle32_t first;
+      ulittle32_t size;
+    };
+    // size records at offset in the file
+    struct Table {
+      ulittle32_t offset;
+      ulittle32_t size;
+    };
+
+    struct Header {
+      char magic[8];
+      ulittle32_t is_transform;
+      Table strings;    // char
+      Table types;      // Type, the elements of a type come before it
+      Table elems;      // ulittle32_t, types of the elements of V and P
+      Table indices;    // ulittle64_t, indices of P
+      Table functions;  // Function, sorted by name
+      Table calls;      // Call
+      Table args;       // ulittle32_t, types of the arguments
+      Table references; // Str, sorted
+      Table facts;      // Fact, definitions and then globals
+      ulittle32_t num_definitions;
+      Table rewrites;   // Rewrite
+      Table perms;      // ulittle32_t, arguments of the rewrites
+    };
+
+    // See the fields of PrevirtType
+    struct Type {
+      ulittle32_t kind;
+      ulittle32_t flags;
+      ulittle64_t word;
+      Str str;
+      Range elems;
+      Range indices;
+    };
+
+    struct Function {
+      Str name;
+      Range calls;
+    };
+
+    struct Call {
+      ulittle32_t count;
+      Range args;
+      ulittle32_t rewrite; // NoRewrite in interfaces
+    };
+
+    struct Rewrite {
+      Str function;
+      Range args;
+    };
+
+    struct Fact {
+      Str name;
+      ulittle32_t value; // type
+      ulittle32_t nonnull;
+      ulittle32_t bits;
+      Str lo;
+      Str hi;
+    };
+  }
+
+  class FlatInterface {
+  private:
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    const flat::Header* header;
+
+    FlatInterface(std::unique_ptr<llvm::MemoryBuffer> buffer);
+    template<typename T>
+    llvm::ArrayRef<T> table(const flat::Table&) const;
+    bool validate() const;
+
+  public:
+    static bool isFlat(llvm::StringRef data);
+    // Return nullptr if buffer is not a well-formed flat file
+    static std::unique_ptr<FlatInterface>
+    open(std::unique_ptr<llvm::MemoryBuffer> buffer);
+    // Return nullptr if filename cannot be mapped or is not a
+    // well-formed flat file (e.g., it is a protobuf file)
+    static std::unique_ptr<FlatInterface> open(const std::string& filename);
+
+  public:
+    // in place queries
+    bool isTransform() const;
+    llvm::StringRef str(const flat::Str&) const;
+    llvm::ArrayRef<flat::Function> functions() const;
+    const flat::Function* findFunction(llvm::StringRef) const;
+    llvm::ArrayRef<flat::Call> calls(const flat::Function&) const;
+    llvm::ArrayRef<flat::ulittle32_t> args(const flat::Call&) const;
+    bool isReferenced(llvm::StringRef) const;
+    PrevirtType type(uint32_t) const;
+
+  public:
+    // add the calls, references and facts to ci
+    void load(ComponentInterface& ci) const;
+    // add the rewritten calls to rw
+    void load(ComponentInterfaceTransform& rw) const;
+    // add the rewritten calls to f to rw
+    void load(ComponentInterfaceTransform& rw, const flat::Function& f) const;
+  };
+
+  void writeFlat(const ComponentInterface& ci, llvm::raw_ostream& out);
+  void writeFlat(const ComponentInterfaceTransform& rw, llvm::raw_ostream& out);
+
+  // Write ci (rw) to filename in the flat format if flat and in the
+  // protobuf format otherwise.
+  bool writeInterfaceFile(const ComponentInterface& ci,
+                          const std::string& filename, bool flat);
+  bool writeTransformFile(const ComponentInterfaceTransform& rw,
+                          const std::string& filename, bool flat);
+  // same with the format selected by -Pflat-interfaces
+  bool writeInterfaceFile(const ComponentInterface& ci,
+                          const std::string& filename);
+  bool writeTransformFile(const ComponentInterfaceTransform& rw,
+                          const std::string& filename);
+}
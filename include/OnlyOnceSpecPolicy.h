@@ -49,6 +49,11 @@ namespace previrt {
     // Functions that cannot be copied because it is called more than
     // once. Used only for intra specialization.
     llvm::DenseSet<const llvm::Function*> m_blacklist;
+    // Functions that are copies made by previous runs of the
+    // specializer on the module.
+    llvm::DenseSet<const llvm::Function*> m_specialized;
+
+    bool isSpecialized(const llvm::Function& F) const;
   public:
 
     // Constructor for inter specialization
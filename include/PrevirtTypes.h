@@ -43,10 +43,17 @@
 #include "Serializer.h"
 #include "proto/Previrt.pb.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringRef.h"
+
 #include <map>
+#include <memory>
+#include <vector>
 
 namespace llvm {
   class Value;
+  class GlobalVariable;
   class Type;
   class LLVMContext;
 }
@@ -56,11 +63,41 @@ namespace previrt {
 #define EXACT_MATCH  0
 #define LOOSE_MATCH  1
 
+  // The protobuf encoding of a type (proto::PrevirtType) is only
+  // used to read and write files: in memory a type is a small value
+  // whose strings are interned, so it is cheap to copy and compare.
   class PrevirtType {
   private:
-    proto::PrevirtType buffer;
+    struct Aggregate;
+    proto::Type kind;
+    // I: bit width, F: float semantics, S: cstr, G: GlobalFlags,
+    // P: is_local
+    uint32_t flags;
+    // G: is_const is only encoded for global variables
+    enum GlobalFlags { G_CONST = 1, G_VARIABLE = 2 };
+    // I: the value if it fits in 64 bits
+    uint64_t word;
+    // interned. I: the hex value if wider than 64 bits, F: the hex
+    // value, S: the data, G and P: the name of the global
+    llvm::StringRef str;
+    // V: the elements, P: the initializer (as only element) and the
+    // indices
+    std::shared_ptr<const Aggregate> agg;
+    // approximate size of the encoding of the type
+    size_t byteSize() const;
+    static llvm::StringRef intern(llvm::StringRef);
     typedef std::map<llvm::Type*, llvm::Function*> EqCache;
     static EqCache cacheEq;
+    // Abstract val following at most depth pointers to constant
+    // globals.
+    static PrevirtType
+    abstract(const llvm::Value* const val, unsigned depth);
+    // Abstract a pointer to the constant global gv, indexed by
+    // indices, into out.
+    static bool
+    abstractPointer(const llvm::GlobalVariable* gv,
+                    llvm::ArrayRef<uint64_t> indices, unsigned depth,
+                    PrevirtType& out);
   public:
     PrevirtType();
     PrevirtType(const proto::PrevirtType&);
@@ -70,12 +107,20 @@ namespace previrt {
     unknown();
 
   public:
-    PrevirtType& operator=(const PrevirtType&);
     bool operator!=(const PrevirtType&) const;
     bool operator==(const PrevirtType&) const;
+    // consistent with operator==
+    llvm::hash_code hash() const;
 
   public:
     int refines(const llvm::Value* const) const;
+    // Add to out a representative (up to operator==) of each type t
+    // that abstract can produce such that t.refines(val) != NO_MATCH.
+    static void refining(const llvm::Value* const val,
+                         std::vector<PrevirtType>& out);
+    // Return nullptr if the value cannot be built with the given
+    // type (only possible for aggregates and pointers into constant
+    // globals).
     llvm::Value* concretize(llvm::Module&, llvm::Type*) const;
     bool isConcrete() const;
     bool isUnknown() const;
@@ -87,6 +132,13 @@ namespace previrt {
 
   public:
     FRIEND_SERIALIZERS(PrevirtType, proto::PrevirtType)
+    friend class FlatInterface;
+    friend class FlatWriter;
+  };
+
+  struct PrevirtType::Aggregate {
+    std::vector<PrevirtType> elems;
+    std::vector<uint64_t> indices;
   };
 }
 
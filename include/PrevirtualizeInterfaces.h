@@ -33,6 +33,7 @@
 
 #pragma once 
 
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Function.h"
 
@@ -40,11 +41,13 @@
 #include <string>
 #include <set>
 #include <map>
+#include <unordered_map>
 
 #include "PrevirtTypes.h"
 
 namespace llvm {
   //class Value;
+  class raw_ostream;
 }
 
 namespace previrt
@@ -71,6 +74,36 @@ namespace previrt
     Create(const std::vector<PrevirtType>&, unsigned count = 0);
   };
 
+  // What is known about the value returned by a function or about
+  // the value of a constant global.
+  struct Fact
+  {
+    PrevirtType value; // unknown unless it is always the same constant
+    bool nonnull;
+    // unsigned range [lo, hi] in hex, bits is 0 if there is no range
+    unsigned bits;
+    std::string lo;
+    std::string hi;
+  public:
+    Fact() : nonnull(false), bits(0) { }
+    bool empty() const;
+
+  public:
+    FRIEND_SERIALIZERS(Fact,proto::Fact)
+  };
+
+  // Precision dropped by ComponentInterface::widen
+  struct WidenStats
+  {
+    unsigned functions; // functions whose calls were widened
+    unsigned before;    // calls to those functions before widening
+    unsigned after;     // and after
+    unsigned args;      // argument positions widened to unknown
+  public:
+    WidenStats() : functions(0), before(0), after(0), args(0) { }
+    void print(llvm::raw_ostream&) const;
+  };
+
   class ComponentInterface {
   public:
     typedef llvm::StringMap<std::vector<CallInfo*> >::const_iterator
@@ -80,6 +113,9 @@ namespace previrt
   public:
     llvm::StringMap<std::vector<CallInfo*> > calls;
     std::set<std::string> references;
+    // facts about the functions and globals defined by the module
+    std::map<std::string, Fact> definitions;
+    std::map<std::string, Fact> globals;
 
   public:
     ComponentInterface();
@@ -94,9 +130,49 @@ namespace previrt
 
     void reference(llvm::StringRef);
 
+    void define(llvm::StringRef f, const Fact&);
+    void defineGlobal(llvm::StringRef g, const Fact&);
+
     CallInfo* getOrCreateCall(FunctionHandle f, const std::vector<PrevirtType>& args);
 
+    // merge the calls, references and facts of the other interfaces
+    // into this one, adding up the counts of identical calls. Returns
+    // true if a new call or reference was added.
+    bool join(const std::vector<const ComponentInterface*>& others);
+    bool join(const ComponentInterface& other);
+
+    // bound the number of calls to each function: once a function
+    // has more than limit distinct calls, the argument positions that
+    // take the most distinct values are made unknown and the calls
+    // that become identical are merged, until at most limit remain
+    // (or no position varies). This invalidates the CallInfo pointers
+    // of the widened functions. Returns true if a call was widened.
+    bool widen(unsigned limit, WidenStats& stats);
+    // same with the limit given by -Pinterface-widen (0: no widening)
+    bool widen(WidenStats& stats);
+
+    // hash of a call signature, consistent with PrevirtType::operator==
+    static llvm::hash_code signature(llvm::StringRef f,
+                                     const std::vector<PrevirtType>& args);
+
     void dump() const;
+
+  private:
+    // Index of the calls to a function so that call, callAny and
+    // getOrCreateCall do not scan all of them. The calls are only
+    // appended so the index catches up with the calls added
+    // elsewhere (join, deserialization) when it is used.
+    struct CallIndex {
+      unsigned size;
+      // signature of the arguments -> position of the call
+      std::unordered_multimap<size_t, unsigned> exact;
+      // distinct values of the arguments -> position of the call
+      std::unordered_multimap<size_t, unsigned> values;
+      CallIndex() : size(0) { }
+    };
+    llvm::StringMap<CallIndex> indexes;
+
+    CallIndex& getIndex(llvm::StringRef f, const std::vector<CallInfo*>& infos);
     
   public:
     // iteration over the functions
@@ -175,5 +251,53 @@ namespace previrt
             ComponentInterfaceTransform>(const proto::ComponentInterface&,
             ComponentInterfaceTransform&);
   };
+
+  // The rewrites of a transform indexed for rewriting the call sites
+  // of a module. lookup agrees with
+  // ComponentInterfaceTransform::lookupRewrite but only looks at the
+  // calls whose arguments refine those of the call site, and
+  // remembers its answer for each combination of argument values.
+  class RewriteTable {
+  public:
+    struct Entry {
+      const CallRewrite* rewrite;
+      // the arguments kept by the rewrite
+      llvm::BitVector kept;
+    };
+
+  public:
+    // the transform must outlive the table
+    explicit RewriteTable(const ComponentInterfaceTransform&);
+
+    // the rewrite of a call to f with the given arguments, or NULL
+    const Entry* lookup(llvm::StringRef f, llvm::User::op_iterator,
+                        llvm::User::op_iterator);
+
+  private:
+    struct TypeHash {
+      size_t operator()(const PrevirtType& t) const { return t.hash(); }
+    };
+    // positions of calls in increasing order
+    typedef std::vector<unsigned> CallList;
+    typedef std::unordered_map<PrevirtType, CallList, TypeHash> ValueMap;
+    typedef std::vector<std::vector<PrevirtType> > Candidates;
+
+    struct Table {
+      // one per call of the interface, rewrite is NULL if the call
+      // is not rewritten
+      std::vector<Entry> entries;
+      // calls are preferred by their number of unknown arguments
+      std::vector<unsigned> scores;
+      // number of arguments -> calls
+      std::map<unsigned, CallList> arities;
+      // argument position -> value -> calls with that value there
+      std::vector<ValueMap> positions;
+      // answers for the values that can refine the arguments
+      std::unordered_multimap<size_t, std::pair<Candidates, int> > memo;
+    };
+    llvm::StringMap<Table> tables;
+
+    static int decide(const Table&, const Candidates&);
+  };
 }
 
@@ -0,0 +1,113 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include "SpecializationPolicy.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace previrt {
+  /* 
+   * This policy is actually a "functor" policy (i.e., it takes as
+   * argument another policy p for the arguments that are constant
+   * at the call site).
+   *
+   * Specialize a call site on the dominant value of an argument
+   * according to a value profile collected at runtime. The profile is
+   * a text file with one entry per line:
+   *
+   *    <file>:<line>[:<column>] <callee> <argument index> <value> <count>
+   *
+   * where <file>:<line>:<column> is the source location of the call,
+   * as recorded in the debug information of the program (so it must
+   * be compiled with -g). Only the name of the file is compared, not
+   * its directory. Without a column the entry is for all the calls to
+   * <callee> on that line. Source locations survive optimization and
+   * inlining, and are also those of the deployed binary: a profiler
+   * that records the return address of each call to <callee> and the
+   * value of the argument maps the address back to the call with
+   * addr2line.
+   *
+   * An argument is specialized if the call site was executed at least
+   * m_min_count times and the value was seen at least m_min_percent
+   * percent of the time. Only integer arguments are considered. Since
+   * the value is not known statically, the specializer must call the
+   * copy behind a guard (see guardCallSite).
+   *
+   * For inter-module specialization the guard cannot be expressed so
+   * the profile only restricts p to hot functions.
+  */
+  class ProfileSpecPolicy : public SpecializationPolicy {
+    
+    struct ArgProfile {
+      uint64_t total;
+      std::map<int64_t, uint64_t> values;
+      ArgProfile(): total(0) {}
+    };
+    // argument index -> profile
+    typedef std::map<unsigned, ArgProfile> CallProfile;
+    // column (0: any column) -> profile
+    typedef std::map<unsigned, CallProfile> LineProfile;
+    // "<file>:<line> <callee>" -> profile
+    llvm::StringMap<LineProfile> m_calls;
+    // callee -> number of calls
+    llvm::StringMap<uint64_t> m_callees;
+
+    std::unique_ptr<SpecializationPolicy> m_subpolicy;
+    const unsigned m_min_count;
+    const unsigned m_min_percent;
+
+    bool readProfile(const std::string& filename);
+    
+  public:
+
+    ProfileSpecPolicy(std::unique_ptr<SpecializationPolicy> subpolicy,
+		      const std::string& profile,
+		      unsigned min_count, unsigned min_percent);
+
+    virtual ~ProfileSpecPolicy() = default;
+
+    virtual bool intraSpecializeOn(llvm::CallSite CS,
+				   std::vector<llvm::Value*>& marks) override;
+    
+    virtual bool interSpecializeOn(const llvm::Function& F,
+				   const std::vector<PrevirtType>& args,
+				   const ComponentInterface& interface,
+				   llvm::SmallBitVector& marks) override;
+  };
+
+} // end namespace
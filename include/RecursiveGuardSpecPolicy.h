@@ -32,11 +32,17 @@
 //
 #pragma once
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallBitVector.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/Analysis/CallGraph.h"
 
 #include "SpecializationPolicy.h"
 
+#include <functional>
+#include <set>
+#include <vector>
+
 namespace previrt {
   /* 
    * This policy is actually a "functor" policy (i.e., it takes as
@@ -44,6 +50,14 @@ namespace previrt {
    *
    * Allows a new (specialized) copy of a function if it is not
    * recursive AND p also decides to specialize.
+   *
+   * If unfold is set, a recursive function can also be specialized
+   * on the arguments that are passed unchanged around its SCC (so
+   * the recursive calls in the copies target the copies) and on
+   * max_depth other constant arguments. The latter unfolds the
+   * recursion at most max_depth times. Only the calls that need a
+   * new copy are charged: a call with the scheme of an existing
+   * copy reuses it.
   */
   class RecursiveGuardSpecPolicy : public SpecializationPolicy {
     
@@ -52,15 +66,39 @@ namespace previrt {
     llvm::CallGraph& m_cg;
     std::unique_ptr<SpecializationPolicy> m_subpolicy;
     FunctionSet m_rec_functions;
+    bool m_unfold;
+    unsigned m_max_depth;
+    // parameters of the recursive functions that are invariant
+    // across their SCC
+    llvm::DenseMap<const llvm::Function*, llvm::SmallBitVector> m_invariant;
+    // copies of a recursive function on varying arguments
+    llvm::DenseMap<const llvm::Function*, unsigned> m_unfolded;
+    // schemes of the copies of the recursive functions: made by
+    // previous runs or allowed by intraSpecializeOn
+    typedef std::vector<llvm::Value*> SpecScheme;
+    llvm::DenseMap<const llvm::Function*, std::set<SpecScheme>> m_copies;
+    // arguments of the copies allowed by interSpecializeOn (unknown
+    // if not specialized)
+    llvm::DenseMap<const llvm::Function*,
+		   std::vector<std::vector<PrevirtType>>> m_inter_copies;
     
     void markRecursiveFunctions();
+    void markInvariantArguments(const std::vector<llvm::Function*>& scc);
+    void countUnfoldings();
     bool isRecursive(const llvm::Function& f) const;    
     bool allowSpecialization(const llvm::Function& f) const;
+    // Keep the marks allowed for the recursive function f. A new
+    // copy on varying arguments is charged to the budget of f unless
+    // hasCopy says that a copy with the restricted marks already
+    // exists. Return false if no mark is left.
+    bool restrictMarks(const llvm::Function& f, llvm::SmallBitVector& marks,
+		       const std::function<bool(const llvm::SmallBitVector&)>& hasCopy);
 
   public:
     
     RecursiveGuardSpecPolicy(std::unique_ptr<SpecializationPolicy> subpolicy,
-			     llvm::CallGraph& cg);
+			     llvm::CallGraph& cg,
+			     bool unfold = false, unsigned max_depth = 0);
 
     virtual ~RecursiveGuardSpecPolicy() = default;
     
@@ -58,7 +58,10 @@ namespace previrt {
     AGGRESSIVE,   // always specialize
     BOUNDED,      // always specialize up to certain threshold
     ONLY_ONCE,    // specialize if function called only once
-    NONREC        // always specialize if function is non-recursive
+    NONREC,       // always specialize if function is non-recursive
+    COST_BENEFIT, // specialize if it pays off under a growth budget
+    PROFILE,      // specialize also on values from a runtime profile
+    RECURSIVE     // NONREC but also recursive functions, up to a depth
   };
   
   class SpecializationPolicy {
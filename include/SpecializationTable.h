@@ -42,8 +42,11 @@
 
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/SmallBitVector.h"
 
+#include <memory>
 #include <vector>
 
 namespace llvm
@@ -60,14 +63,59 @@ namespace previrt
   public:
     typedef std::vector<llvm::Value*> SpecScheme;
 
+    // Hash of a scheme. Constants are uniqued by LLVM so the scheme
+    // can be hashed and compared by pointer.
+    struct SchemeInfo {
+      static inline llvm::ArrayRef<llvm::Value*> getEmptyKey() {
+	return llvm::ArrayRef<llvm::Value*>
+	  (llvm::DenseMapInfo<llvm::Value**>::getEmptyKey(), (size_t) 0);
+      }
+      static inline llvm::ArrayRef<llvm::Value*> getTombstoneKey() {
+	return llvm::ArrayRef<llvm::Value*>
+	  (llvm::DenseMapInfo<llvm::Value**>::getTombstoneKey(), (size_t) 0);
+      }
+      static unsigned getHashValue(llvm::ArrayRef<llvm::Value*> s) {
+	return llvm::hash_combine_range(s.begin(), s.end());
+      }
+      static bool isEqual(llvm::ArrayRef<llvm::Value*> l,
+			  llvm::ArrayRef<llvm::Value*> r) {
+	if (l.data() == getEmptyKey().data() ||
+	    l.data() == getTombstoneKey().data() ||
+	    r.data() == getEmptyKey().data() ||
+	    r.data() == getTombstoneKey().data()) {
+	  return l.data() == r.data();
+	}
+	return l == r;
+      }
+    };
+
+    struct Specialization;
+
+    // Trie over the argument positions of the children of a
+    // specialization. The edge at depth i is labeled with the i-th
+    // argument of the scheme (nullptr if not specialized).
+    struct SchemeTrie {
+      llvm::DenseMap<llvm::Value*, std::unique_ptr<SchemeTrie>> next;
+      // only at depth == number of arguments
+      std::vector<Specialization*> leaves;
+    };
+
     struct Specialization {
       llvm::Function* handle;
       SpecScheme args;
       const Specialization* parent;
       std::vector<Specialization*> children;
+      // number of specializations from the principal function
+      unsigned depth;
+      // position in parent->children
+      unsigned index;
+      // indexes of children
+      llvm::DenseMap<llvm::ArrayRef<llvm::Value*>, Specialization*, SchemeInfo> exact;
+      SchemeTrie refined;
 
       // Return true if l is more specific than r
-      static bool refines(SpecScheme l, SpecScheme r);
+      static bool refines(llvm::ArrayRef<llvm::Value*> l,
+			  llvm::ArrayRef<llvm::Value*> r);
     };
 
   private:
@@ -84,16 +132,34 @@ namespace previrt
     
     virtual ~SpecializationTable();
       
+    // Reload the specializations recorded in the module, and drop
+    // the records of the functions deleted since then.
     void initialize(llvm::Module*);
       
-    void getSpecializations(llvm::Function*, SpecScheme,
+    // Specializations of a function that refine the scheme, in the
+    // order they were added.
+    void getSpecializations(llvm::Function*, llvm::ArrayRef<llvm::Value*>,
 			    std::vector<const Specialization*>&) const;
+
+    // Specialization of a function with exactly the scheme or null.
+    const Specialization* findSpecialization(llvm::Function*,
+					     llvm::ArrayRef<llvm::Value*>) const;
     
-    bool addSpecialization(llvm::Function*, SpecScheme, llvm::Function*, bool record=true);
+    bool addSpecialization(llvm::Function*, llvm::ArrayRef<llvm::Value*>,
+			   llvm::Function*, bool record=true);
 
     const Specialization* getPrincipalSpecialization(llvm::Function*) const;
       
     Specialization* getSpecialization(llvm::Function*) const;
+
+    // Return null if the function is not in the table.
+    const Specialization* lookupSpecialization(const llvm::Function*) const;
+
+    // Specializations in the table. Principal functions are
+    // included with a null parent.
+    typedef SpecTable::const_iterator iterator;
+    iterator begin() const { return specialized.begin(); }
+    iterator end() const { return specialized.end(); }
     
     const llvm::Function* getPrincipalFunction(const llvm::Function*) const;
     
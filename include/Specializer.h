@@ -31,6 +31,8 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace llvm
@@ -39,6 +41,9 @@ namespace llvm
   class Value;
   class BasicBlock;
   class GlobalVariable;
+  class Constant;
+  class Instruction;
+  class Module;
 }
 
 namespace previrt
@@ -50,6 +55,15 @@ namespace previrt
   llvm::Function* specializeFunction(llvm::Function *f,
 				     const std::vector<llvm::Value*>& args);
 
+  /*
+   * If f is a specialized function, return true and set principal to
+   * the name of the function it was specialized from and args to its
+   * arguments ("?" if not specialized). The information is read from
+   * the metadata of f or, if it has none, parsed from its name.
+   */
+  bool getSpecializationInfo(const llvm::Function& f, std::string& principal,
+			     std::vector<std::string>& args);
+
   /*
    * Specialize a call site and return the new instruction.
    * Return null if I is not CallInst or InvokeInst.
@@ -61,6 +75,23 @@ namespace previrt
 					llvm::Function*,
 					const std::vector<unsigned>&perm);
 
+  /*
+   * Replace the call cs with
+   *
+   *   if (arg_i == c_i && ...) newInst else cs
+   *
+   * where guards are the pairs (i, c_i) and newInst is the call to
+   * the specialized function returned by specializeCallSite. cs is
+   * marked as a fallback so that it is not guarded again.
+   */
+  void guardCallSite(llvm::Instruction* cs, llvm::Instruction* newInst,
+		     const std::vector<std::pair<unsigned, llvm::Constant*>>& guards);
+
+  /*
+   * Return true if cs is the fallback call left by guardCallSite.
+   */
+  bool isGuardFallback(const llvm::Instruction* cs);
+
   /*
    * Create a LLVM global variable from a string.
    */
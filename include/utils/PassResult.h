@@ -0,0 +1,38 @@
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <string>
+
+namespace llvm {
+  class Module;
+}
+
+namespace previrt {
+namespace utils {
+
+  /* 
+   * Structured result of an OCCAM transformation pass.
+   *
+   * If -Presult-output=<file> is given, report() appends one line to
+   * <file> with the name of the pass, whether it changed the module and
+   * how many functions it added and removed:
+   *
+   *   {"pass":"Prewrite","changed":true,"added":3,"removed":0}
+   *
+   * This is how razor learns that a pass made progress.
+   */
+  class PassResult {
+    std::string m_pass;
+    llvm::StringSet<> m_functions;
+    
+  public:
+    // Remember the functions of M before the pass runs.
+    PassResult(llvm::StringRef pass, const llvm::Module& M);
+
+    void report(const llvm::Module& M, bool changed) const;
+  };
+  
+}
+}
@@ -0,0 +1,260 @@
+"""
+ OCCAM
+
+ Copyright (c) 2011-2020, SRI International
+
+  All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+ * Neither the name of SRI International nor the names of its contributors may
+   be used to endorse or promote products derived from this software without
+   specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+
+ Content-addressed cache of OCCAM pass invocations.
+
+ An invocation of driver.previrt/previrt_progress is identified by the
+ hash of its input module, its arguments (files given as arguments are
+ replaced by the hash of their content), and the OCCAM libraries and
+ opt in use. The cache stores the output module, the files the pass
+ writes through its output options, the progress flag and the log, so
+ that a hit replays the invocation without running the pass.
+
+ Entries live in <dir>/<key>/ and are evicted least recently used first
+ when the store grows over its size limit.
+
+"""
+import hashlib
+import json
+import os
+import shutil
+import sys
+import tempfile
+import threading
+import time
+from distutils.spawn import find_executable
+
+from . import config
+from . import persistent
+from . import trace
+from .version import razor_version
+
+# Options whose value is a file written by the pass
+OUTPUT_OPTIONS = ['-Pinterface-output',
+                  '-Pspecialize-output',
+                  '-profile-outfile',
+                  '-Pcost-benefit-output',
+                  '--Pcost-benefit-output',
+                  '-Presult-output']
+
+_dir = None
+_limit = 0
+_lock = threading.Lock()
+_version = None
+_stats = {'hits' : 0, 'misses' : 0, 'stores' : 0, 'evictions' : 0,
+          'saved' : 0.0}
+
+def enable(cache_dir, limit_mb):
+    """ Caches pass invocations in cache_dir, using at most limit_mb MB.
+    """
+    global _dir, _limit
+    if not os.path.isdir(cache_dir):
+        os.makedirs(cache_dir)
+    _dir = os.path.abspath(cache_dir)
+    _limit = limit_mb * 1024 * 1024
+
+def enabled():
+    return _dir is not None
+
+def _digest(path):
+    h = hashlib.sha1()
+    with open(path, 'rb') as fd:
+        while True:
+            block = fd.read(1 << 20)
+            if not block:
+                break
+            h.update(block)
+    return h.hexdigest()
+
+def _tools_version():
+    """ Identifies the OCCAM libraries and the opt used to run the passes.
+    """
+    global _version
+    with _lock:
+        if _version is None:
+            h = hashlib.sha1(razor_version)
+            opt = config.get_llvm_tool('opt')
+            if not os.path.isabs(opt):
+                opt = find_executable(opt)
+            for lib in [config.get_sea_dsalib(), config.get_llvm_dsalib(),
+                        config.get_occamlib(), opt]:
+                if lib is not None and os.path.isfile(lib):
+                    h.update(_digest(lib))
+            _version = h.hexdigest()
+        return _version
+
+def _key(fin, args):
+    """ Returns the key of an invocation and the output files in args.
+    """
+    h = hashlib.sha1(_tools_version())
+    h.update(_digest(fin))
+    outputs = []
+    output_next = False
+    for a in args:
+        if output_next:
+            outputs.append(a)
+            output_next = False
+            a = '<output>'
+        else:
+            (name, eq, value) = a.partition('=')
+            if name in OUTPUT_OPTIONS:
+                if eq:
+                    outputs.append(value)
+                    a = name + '=<output>'
+                else:
+                    output_next = True
+            elif eq and os.path.isfile(value):
+                a = name + '=' + _digest(value)
+            elif os.path.isfile(a):
+                a = _digest(a)
+        h.update(a)
+        h.update('\0')
+    return (h.hexdigest(), outputs)
+
+def _entry(key):
+    return os.path.join(_dir, key)
+
+def _lookup(key, fout, outputs):
+    """ Restores the entry for key into fout and outputs, if any.
+    """
+    entry = _entry(key)
+    try:
+        with open(os.path.join(entry, 'meta'), 'r') as fd:
+            meta = json.load(fd)
+        if len(meta['outputs']) != len(outputs):
+            return None
+        if fout != '/dev/null':
+            persistent.discard([fout])
+            shutil.copyfile(os.path.join(entry, 'module.bc'), fout)
+        for (i, o) in enumerate(outputs):
+            if meta['outputs'][i]:
+                shutil.copyfile(os.path.join(entry, 'out.{0}'.format(i)), o)
+        # The modification time of an entry is its last use
+        os.utime(entry, None)
+    except (IOError, OSError, ValueError, KeyError):
+        return None
+    return meta
+
+def _store(key, fout, outputs, meta):
+    tmp = tempfile.mkdtemp(prefix='.tmp.', dir=_dir)
+    try:
+        if fout != '/dev/null':
+            persistent.sync([fout])
+            shutil.copyfile(fout, os.path.join(tmp, 'module.bc'))
+        meta['outputs'] = []
+        for (i, o) in enumerate(outputs):
+            present = os.path.isfile(o)
+            if present:
+                shutil.copyfile(o, os.path.join(tmp, 'out.{0}'.format(i)))
+            meta['outputs'].append(present)
+        with open(os.path.join(tmp, 'meta'), 'w') as fd:
+            json.dump(meta, fd)
+        # another thread may have stored the same entry meanwhile
+        os.rename(tmp, _entry(key))
+    except (IOError, OSError, ValueError):
+        shutil.rmtree(tmp, ignore_errors=True)
+        return
+    with _lock:
+        _stats['stores'] += 1
+
+def run(fin, fout, args, f):
+    """ Returns f() or its cached value.
+
+        f runs the pass and returns (result, log); result must be an
+        integer return code or a progress flag.
+    """
+    persistent.sync([fin])
+    lookup_start = time.time()
+    (key, outputs) = _key(fin, args)
+    meta = _lookup(key, fout, outputs)
+    if meta is not None:
+        with _lock:
+            _stats['hits'] += 1
+            _stats['saved'] += meta['time']
+        (module, name) = trace.describe('cache', [fin] + args)
+        trace.record(name, lookup_start, time.time(), file=module, cache='hit')
+        return (meta['result'], meta['log'].encode('utf-8'))
+    with _lock:
+        _stats['misses'] += 1
+    start = time.time()
+    with trace.annotate(cache='miss'):
+        (result, log) = f()
+    elapsed = time.time() - start
+    if result is True or result is False or result == 0:
+        if fout == '/dev/null' or persistent.holds(fout) or os.path.isfile(fout):
+            _store(key, fout, outputs, {'result' : result,
+                                        # the output of the passes
+                                        # is not always UTF-8
+                                        'log' : (log or '').decode('utf-8', 'replace'),
+                                        'time' : elapsed})
+    return (result, log)
+
+def trim():
+    """ Evicts the least recently used entries over the size limit.
+    """
+    if not enabled():
+        return
+    entries = []
+    total = 0
+    for e in os.listdir(_dir):
+        path = os.path.join(_dir, e)
+        if e.startswith('.') or not os.path.isdir(path):
+            continue
+        size = 0
+        for f in os.listdir(path):
+            size += os.path.getsize(os.path.join(path, f))
+        entries.append((os.path.getmtime(path), size, path))
+        total += size
+    entries.sort()
+    for (_, size, path) in entries:
+        if total <= _limit:
+            break
+        shutil.rmtree(path, ignore_errors=True)
+        total -= size
+        _stats['evictions'] += 1
+
+def report():
+    """ Trims the store and prints the statistics of this run.
+    """
+    if not enabled():
+        return
+    trim()
+    sys.stderr.write('Pass cache {0}: {1} hits, {2} misses, {3} stored, '
+                     '{4} evicted, {5:.2f}s saved\n'.format(_dir,
+                                                            _stats['hits'],
+                                                            _stats['misses'],
+                                                            _stats['stores'],
+                                                            _stats['evictions'],
+                                                            _stats['saved']))
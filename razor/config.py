@@ -55,8 +55,9 @@ __libext = libExtension()
 class ConfigObj(object):
     """All access to the environment comes through this class.
     """
-    def  __init__(self, libfile, seadsalib, llvmdsalib, llpelibs):
+    def  __init__(self, libfile, seadsalib, llvmdsalib, llpelibs, driver):
         self._occamlib = libfile
+        self._occamdriver = driver
         self._seadsalib = seadsalib
         self._llvmdsalib = llvmdsalib
         self._llpelibs = llpelibs
@@ -84,6 +85,11 @@ class ConfigObj(object):
         """
         return self._occamlib
 
+    def get_occam_driver(self):
+        """ Returns the path to the occam persistent pass driver.
+        """
+        return self._occamdriver
+
     def get_sea_dsalib(self):
         """ Returns the path to the SeaHorn DSA library.
         """
@@ -116,6 +122,33 @@ def get_occamlib_path():
     sys.stderr.write('Unsupported platform: {0}\n'.format(__system))
     return None
 
+def get_occam_driver_path():
+    """ Deduces the full path to the occam persistent pass driver.
+    """
+    home = os.getenv('OCCAM_HOME')
+    if home is None:
+        sys.stderr.write('OCCAM_HOME not set!\n')
+        return None
+    return os.path.join(home, 'bin', 'occam-driver')
+
+def get_occam_iface_join_path():
+    """ Deduces the full path to the occam interface join tool.
+    """
+    home = os.getenv('OCCAM_HOME')
+    if home is None:
+        sys.stderr.write('OCCAM_HOME not set!\n')
+        return None
+    return os.path.join(home, 'bin', 'occam-iface-join')
+
+def get_occam_iface_convert_path():
+    """ Deduces the full path to the occam interface conversion tool.
+    """
+    home = os.getenv('OCCAM_HOME')
+    if home is None:
+        sys.stderr.write('OCCAM_HOME not set!\n')
+        return None
+    return os.path.join(home, 'bin', 'occam-iface-convert')
+
 def get_sea_dsalib_path():
     """ Deduces the full path to the SeaHorn DSA shared/dynamic library.
     """
@@ -167,13 +200,29 @@ def get_logfile():
 CFG = ConfigObj(get_occamlib_path(), \
                 get_sea_dsalib_path(), \
                 get_llvm_dsalib_path(), \
-                get_llpelibs_paths())
+                get_llpelibs_paths(), \
+                get_occam_driver_path())
 
 def get_occamlib():
     """ Returns the path to the occam shared/dynamic library.
     """
     return CFG.get_occamlib()
 
+def get_occam_driver():
+    """ Returns the path to the occam persistent pass driver.
+    """
+    return CFG.get_occam_driver()
+
+def get_occam_iface_join():
+    """ Returns the path to the occam interface join tool.
+    """
+    return get_occam_iface_join_path()
+
+def get_occam_iface_convert():
+    """ Returns the path to the occam interface conversion tool.
+    """
+    return get_occam_iface_convert_path()
+
 def get_sea_dsalib():
     """ Returns the path to the SeaHorn DSA shared/dynamic library.
     """
@@ -32,11 +32,19 @@
 """
 import subprocess
 import logging
+import hashlib
+import json
 import os.path
+import shutil
+import tempfile
+import time
 
+from . import cache
 from . import config
 from . import echo
+from . import persistent
 from . import stringbuffer
+from . import trace
 
 verbose = False
 
@@ -67,6 +75,44 @@ def all_args(opt, args):
 
 
 def previrt(fin, fout, args, **opts):
+    if cache.enabled():
+        (retcode, _) = cache.run(fin, fout, opt_debug_cmds + args,
+                                 lambda: (_previrt(fin, fout, args, **opts), ''))
+        return retcode
+    return _previrt(fin, fout, args, **opts)
+
+def _persistent(fin, fout, args, log='', save=False):
+    """ Runs OCCAM passes in the persistent driver. Returns 0, or 1 if
+        they failed, in which case fout is not produced.
+
+        With save, the modules held in memory are written to disk first
+        because the passes are known to crash the driver.
+    """
+    report('occam-driver', args + [fin, '-o={0}'.format(fout)])
+    start = time.time()
+    try:
+        if save:
+            persistent.save()
+        persistent.previrt(fin, fout, opt_debug_cmds + args, log)
+    except persistent.DriverError as e:
+        logging.getLogger().error('%s\n', e)
+        if e.dead:
+            lost = persistent.restart()
+            if lost:
+                logging.getLogger().error('occam-driver: lost %s\n', ' '.join(lost))
+        if fout != fin and fout != '/dev/null':
+            persistent.discard([fout])
+            if os.path.isfile(fout):
+                os.unlink(fout)
+        return 1
+    finally:
+        _trace('occam-driver', [fin] + args, start)
+    return 0
+
+def _previrt(fin, fout, args, **opts):
+    if persistent.enabled():
+        return _persistent(fin, fout, args)
+
     libs = ['-load={0}'.format(config.get_sea_dsalib()),
             '-load={0}'.format(config.get_llvm_dsalib()),
             '-load={0}'.format(config.get_occamlib())]
@@ -75,7 +121,75 @@ def previrt(fin, fout, args, **opts):
 
     return run(config.get_llvm_tool('opt'), args, **opts)
 
-def previrt_progress(fin, fout, args, output=None):
+def previrt_progress(fin, fout, args, output=None, may_crash=False):
+    """ Runs OCCAM passes and returns whether one of them made progress.
+
+    The passes append their results (see utils/PassResult.h) to a
+    results file instead of having their stderr searched for progress.
+    If output is given, output[0] is set to the log of the passes.
+    may_crash tells that the passes are known to crash: the persistent
+    driver saves its modules first. If they fail, fout is not produced.
+    """
+    rf = tempfile.NamedTemporaryFile(suffix='.results', delete=False)
+    rf.close()
+    args = args + ['-Presult-output={0}'.format(rf.name)]
+    try:
+        if cache.enabled():
+            def f():
+                out = [None] if output is not None else None
+                retcode = _previrt_progress(fin, fout, args, out, may_crash)
+                return (retcode, out[0] if out is not None else '')
+            (_, log) = cache.run(fin, fout, opt_debug_cmds + args, f)
+            if output != None:
+                output[0] = log
+        else:
+            _previrt_progress(fin, fout, args, output, may_crash)
+        results = pass_results(rf.name)
+    finally:
+        os.unlink(rf.name)
+    for r in results:
+        logging.getLogger().info('%s on %s: changed=%s, +%d/-%d functions\n',
+                                 r['pass'], fin, r['changed'],
+                                 r['added'], r['removed'])
+    return any([r['changed'] for r in results])
+
+def pass_results(filename):
+    """ Parses the results appended by the passes to filename.
+    """
+    results = []
+    with open(filename, 'r') as fd:
+        for line in fd:
+            line = line.strip()
+            if line:
+                results.append(json.loads(line))
+    return results
+
+def module_hash(path):
+    """ Hash of the content of a bitcode file.
+    """
+    if persistent.enabled():
+        persistent.sync([path])
+    h = hashlib.sha1()
+    with open(path, 'rb') as fd:
+        while True:
+            block = fd.read(1 << 20)
+            if not block:
+                break
+            h.update(block)
+    return h.hexdigest()
+
+def _previrt_progress(fin, fout, args, output=None, may_crash=False):
+    if persistent.enabled():
+        if output is None:
+            return _persistent(fin, fout, args, save=may_crash)
+        log = tempfile.NamedTemporaryFile(suffix='.log', delete=False)
+        log.close()
+        retcode = _persistent(fin, fout, args, log.name, save=may_crash)
+        with open(log.name, 'r') as fd:
+            output[0] = fd.read()
+        os.unlink(log.name)
+        return retcode
+
     libs = ['-load={0}'.format(config.get_sea_dsalib()),
             '-load={0}'.format(config.get_llvm_dsalib()),
             '-load={0}'.format(config.get_occamlib())]
@@ -88,12 +202,15 @@ def previrt_progress(fin, fout, args, output=None):
 
     log = logging.getLogger()
 
-    sb = stringbuffer.StringBuffer()
+    # only buffer the output of the passes if the caller wants it
+    sb = stringbuffer.StringBuffer() if output is not None else None
 
     log.log(logging.INFO, 'EXECUTING: %s\n', ' '.join([prog] + args))
 
     args = [prog] + args
 
+    start = time.time()
+
     proc = subprocess.Popen(args,
                             stderr=subprocess.PIPE,
                             stdout=subprocess.PIPE,
@@ -105,18 +222,48 @@ def previrt_progress(fin, fout, args, output=None):
     eobj.wait()
 
     # this should be already finished.
-    retcode = proc.wait()
-
-    progress = str(sb)
+    retcode = _wait(proc, prog, args[1:], start)
 
     logging.getLogger().info('%(cmd)s => %(code)d\n',
                              {'cmd'  : ' '.join(args),
-                              'code' : retcode,
-                              'progress' : progress})
+                              'code' : retcode})
     if output != None:
-        output[0] = progress
-    return '...progress...' in progress
+        output[0] = str(sb)
+    return retcode
+
 
+def copy(src, dst):
+    """ Copies a bitcode file that might only exist in memory.
+    """
+    if persistent.enabled():
+        persistent.sync([src])
+        persistent.discard([dst])
+    shutil.copy(src, dst)
+
+def produced(path):
+    """ Whether the bitcode file exists (on disk or in memory).
+    """
+    if persistent.enabled() and persistent.holds(path):
+        return True
+    return os.path.isfile(path)
+
+def discard(paths):
+    """ Tells the persistent driver that paths will not be read again.
+    """
+    if persistent.enabled():
+        persistent.discard(paths)
+
+def checkpoint():
+    """ Writes to disk the modules that only exist in memory.
+    """
+    if persistent.enabled():
+        persistent.checkpoint()
+
+def shutdown():
+    """ Writes everything to disk and stops the persistent drivers.
+    """
+    if persistent.enabled():
+        persistent.shutdown()
 
 def linker(fin, fout, args):
     args = [fin, '-o', fout] + args
@@ -140,6 +287,19 @@ def opt_stats_output(prog, args):
     return optfp, args
 
 
+def _trace(prog, args, start, rusage=None):
+    if trace.enabled():
+        (module, name) = trace.describe(prog, args)
+        trace.record(name, start, time.time(), rusage, file=module,
+                     tool=os.path.basename(prog))
+
+def _wait(proc, prog, args, start):
+    """ Waits for proc and records it in the trace and for the pool.
+    """
+    rusage = trace.wait(proc)
+    _trace(prog, args, start, rusage)
+    return proc.returncode
+
 def run(prog, args, sb=None, fail_on_error=True):
 
     log = logging.getLogger()
@@ -151,21 +311,33 @@ def run(prog, args, sb=None, fail_on_error=True):
 
     prog = config.get_llvm_tool(prog)
 
+    if persistent.enabled():
+        # the inputs of external tools must be on disk
+        persistent.sync(args)
+
     report(prog, args)
 
     log.log(logging.INFO, 'EXECUTING: %s\n', ' '.join([prog] + args))
 
+    start = time.time()
+
     proc = subprocess.Popen([prog] + args,
                             stderr=outfp,
                             stdout=outfp,
                             stdin=subprocess.PIPE)
 
+    echoes = []
     if outfp == subprocess.PIPE:
-        echo.Echo(proc.stderr, log, sb)
+        echoes.append(echo.Echo(proc.stderr, log, sb))
         if sb is not None:
-            echo.Echo(proc.stdout, None, sb)
+            echoes.append(echo.Echo(proc.stdout, None, sb))
+
+    retcode = _wait(proc, prog, args, start)
 
-    retcode = proc.wait()
+    if sb is not None:
+        # make sure sb holds the whole output
+        for e in echoes:
+            e.wait()
 
     if outfp != subprocess.PIPE:
         outfp.close()
@@ -35,24 +35,59 @@
 
 """
 
+import os
 import re
+import subprocess
 import sys
+import tempfile
 
+from . import config
 from .proto import Previrt_pb2 as pb
 
+# Whether the OCCAM passes write the interfaces in the flat format
+# (slash --flat-interfaces). Flat files are converted to protobuf by
+# occam-iface-convert when they are parsed here.
+flat_interfaces = False
+
+FLAT_MAGIC = b'OCCAMFI1'
+
+# Number of distinct calls to a function after which the interfaces
+# widen its arguments (slash --interface-widen, 0: never)
+widen_limit = 0
+
 def emptyInterface():
     """ Returns an empty interface.
     """
     return pb.ComponentInterface()
 
+def fromFlat(data):
+    """ Returns the protobuf encoding of the flat interface data.
+    """
+    fin = tempfile.NamedTemporaryFile(suffix='.iface', delete=False)
+    fin.write(data)
+    fin.close()
+    fout = tempfile.NamedTemporaryFile(suffix='.iface', delete=False)
+    fout.close()
+    try:
+        subprocess.check_call([config.get_occam_iface_convert(),
+                               '-o', fout.name, fin.name])
+        return open(fout.name, 'rb').read()
+    finally:
+        os.unlink(fin.name)
+        os.unlink(fout.name)
+
 def parseInterface(filename):
-    """ Parses the filename as an interface.
+    """ Parses the filename as an interface, in the protobuf or the
+        flat format.
     """
     result = pb.ComponentInterface()
     if filename == '-':
-        result.ParseFromString(sys.stdin.read())
+        data = sys.stdin.read()
     else:
-        result.ParseFromString(open(filename, 'rb').read())
+        data = open(filename, 'rb').read()
+    if data.startswith(FLAT_MAGIC):
+        data = fromFlat(data)
+    result.ParseFromString(data)
     return result
 
 def writeInterface(iface, filename):
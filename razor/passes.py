@@ -34,7 +34,7 @@
 import sys
 import os
 import tempfile
-import shutil
+import threading
 
 from . import config
 
@@ -68,6 +68,8 @@ def specialize(input_file, output_file, rewrite_file, interfaces, \
         args += ['-Pspecialize-policy={0}'.format(policy)]
     if policy == 'bounded':
         args += ['-Pspecialize-max-bounded={0}'.format(max_bounded)]
+    if policy == 'recursive' and max_bounded is not None:
+        args += ['-Pspecialize-max-recursion-depth={0}'.format(max_bounded)]
     if output_file is None:
         output_file = '/dev/null'
     return driver.previrt(input_file, output_file, args)
@@ -78,11 +80,17 @@ def rewrite(input_file, output_file, rewrites, output=None):
     args = ['-Prewrite'] + driver.all_args('-Prewrite-input', rewrites)
     return driver.previrt_progress(input_file, output_file, args, output)
 
+def facts(input_file, output_file, interfaces):
+    """ uses the return values and constant globals of other modules
+    """
+    args = ['-Pfacts'] + driver.all_args('-Pfacts-input', interfaces)
+    return driver.previrt_progress(input_file, output_file, args)
+
 def force_inline(input_file, output_file, inline_bounce, inline_specialized, output=None):
     """ Force inlining of special functions
     """
     if not inline_bounce and not inline_specialized:
-        shutil.copy(input_file, output_file)
+        driver.copy(input_file, output_file)
         return 0
     
     args = ['-Pinliner']
@@ -129,13 +137,13 @@ def devirt(devirt_method, input_file, output_file):
                  , '-sea-dsa-type-aware=true'
         ]
         
-    retcode = driver.previrt_progress(input_file, output_file, args)
+    retcode = driver.previrt_progress(input_file, output_file, args, may_crash=True)
     if retcode != 0:
         return retcode
 
     #FIXME: previrt_progress returns 0 in cases where --Pdevirt may crash.
     #Here we check that the output_file exists
-    if not os.path.isfile(output_file):
+    if not driver.produced(output_file):
         #Some return code different from zero
         return 3
     else:
@@ -198,6 +206,13 @@ def peval(input_file, output_file, \
           use_llpe, use_ipdse, use_ai_dce, log=None):
     """ intra module specialization/optimization
     """
+    if not (use_llpe or use_ipdse or use_ai_dce) and \
+       all([o == '-disable-inlining' for o in opt_options]):
+        # Nothing needs an external tool: run everything in one process.
+        return peval_pipeline(input_file, output_file, opt_options, \
+                              policy, max_bounded, devirt_method, \
+                              force_inline_bounce, force_inline_spec, log)
+
     opt = tempfile.NamedTemporaryFile(suffix='.bc', delete=False)
     done = tempfile.NamedTemporaryFile(suffix='.bc', delete=False)
     tmp = tempfile.NamedTemporaryFile(suffix='.bc', delete=False)
@@ -209,7 +224,7 @@ def peval(input_file, output_file, \
         retcode = optimize(input_file, output_file, use_seaopt, opt_options)
         if retcode != 0:
             sys.stderr.write("ERROR: intra module optimization failed!\n")
-            shutil.copy(input_file, output_file)
+            driver.copy(input_file, output_file)
         else:
             sys.stderr.write("\tintra module optimization finished succesfully\n")
         return retcode
@@ -218,7 +233,7 @@ def peval(input_file, output_file, \
     disable_opt = False
     
     if disable_opt:
-        shutil.copy(input_file, done.name)
+        driver.copy(input_file, done.name)
     else:
         # Optimize using standard llvm transformations before any other
         # optional pass. Otherwise, these passes will not be very effective.
@@ -230,7 +245,7 @@ def peval(input_file, output_file, \
         retcode = devirt(devirt_method, done.name, tmp.name)
         if retcode != 0:
             sys.stderr.write("ERROR: resolution of indirect calls failed!\n")
-            shutil.copy(done.name, output_file)
+            driver.copy(done.name, output_file)
             return retcode
         sys.stderr.write("\tresolved indirect calls finished succesfully\n")
         # Force inlining bounce functions
@@ -293,12 +308,12 @@ def peval(input_file, output_file, \
         retcode = driver.previrt(done.name, tmp.name, passes)
         if retcode != 0:
             sys.stderr.write("ERROR: ipdse failed!\n")
-            shutil.copy(done.name, output_file)
+            driver.copy(done.name, output_file)
             #FIXME: unlink files
             return retcode
         else:
             sys.stderr.write("\tipdse finished succesfully\n")
-        shutil.copy(tmp.name, done.name)
+        driver.copy(tmp.name, done.name)
 
     if use_ai_dce:
         clam_cmd = utils.get_clam()
@@ -309,7 +324,7 @@ def peval(input_file, output_file, \
             retcode = clam(clam_cmd, done.name, tmp.name)
             if retcode != 0:
                 sys.stderr.write("ERROR: crab failed!\n")
-                shutil.copy(done.name, output_file)
+                driver.copy(done.name, output_file)
                 return retcode
             else:
                 utils.write_timestamp("Finished crab")
@@ -320,26 +335,30 @@ def peval(input_file, output_file, \
                 # retcode = _optimize(tmp.name, done.name, use_ai_dce)
                 # if retcode != 0:
                 #     return retcode
-            shutil.copy(tmp.name, done.name)
+            driver.copy(tmp.name, done.name)
             
     if policy <> 'none':
         out = ['']
         iteration = 0
+        specialized = False
         while True:
             iteration += 1
-            if iteration > 1 or \
-               (use_llpe or use_ipdse):
+            if iteration == 1 and (use_llpe or use_ipdse):
                 # optimize using standard llvm transformations
                 retcode = _optimize(done.name, opt.name, use_ai_dce or use_ipdse)
                 if retcode != 0:
                     break;
             else:
-                shutil.copy(done.name, opt.name)
+                # -Ppeval-opt already optimized the new functions and
+                # their callers in the previous round.
+                driver.copy(done.name, opt.name)
 
             # perform specialization using policies
             pass_args = ['-Ppeval', '-Ppeval-policy={0}'.format(policy), '-Ppeval-opt']
             if policy == 'bounded':
                 pass_args += ['-Ppeval-max-bounded={0}'.format(max_bounded)]
+            if policy == 'recursive' and max_bounded is not None:
+                pass_args += ['-Ppeval-max-recursion-depth={0}'.format(max_bounded)]
                 
             progress = driver.previrt_progress(opt.name, tmp.name, pass_args, output=out)
             sys.stderr.write("\tintra-module specialization finished\n")
@@ -347,15 +366,22 @@ def peval(input_file, output_file, \
             force_inline(tmp.name, done.name, False, force_inline_spec)
             
             if progress:
+                specialized = True
                 if log is not None:
                     log.write(out[0])
             else:
-                shutil.copy(opt.name, done.name)
+                driver.copy(opt.name, done.name)
                 break
+        if specialized:
+            # whole-module optimization once all rounds are done
+            retcode = _optimize(done.name, opt.name, use_ai_dce or use_ipdse)
+            if retcode == 0:
+                driver.copy(opt.name, done.name)
     else:
         print "\tskipped intra-module specialization"
 
-    shutil.copy(done.name, output_file)
+    driver.copy(done.name, output_file)
+    driver.discard([done.name, opt.name, tmp.name])
     try:
         os.unlink(done.name)
         os.unlink(opt.name)
@@ -364,6 +390,47 @@ def peval(input_file, output_file, \
         pass
     return retcode
 
+def peval_pipeline(input_file, output_file, \
+                   opt_options, \
+                   policy, max_bounded, \
+                   devirt_method, \
+                   force_inline_bounce, force_inline_spec, log=None):
+    """ same as peval but all the passes run in a single invocation
+        of -Ppeval-pipeline (see src/PevalPipeline.cpp)
+    """
+    args = ['-Ppeval-pipeline']
+    if '-disable-inlining' in opt_options:
+        args += ['-Ppeval-pipeline-disable-inlining']
+    if devirt_method <> 'none':
+        args += ['-Ppeval-pipeline-devirt']
+        if devirt_method == 'cha_dsa':
+            args += ['-Pdevirt-with-cha']
+        if devirt_method == 'sea_dsa':
+            args += ['-Pdevirt-with-seadsa', '-sea-dsa-type-aware=true']
+        if force_inline_bounce:
+            args += ['-Ppeval-pipeline-inline-bounce']
+    if policy <> 'none':
+        args += ['-Ppeval-policy={0}'.format(policy), '-Ppeval-opt']
+        if policy == 'bounded':
+            args += ['-Ppeval-max-bounded={0}'.format(max_bounded)]
+        if policy == 'recursive' and max_bounded is not None:
+            args += ['-Ppeval-max-recursion-depth={0}'.format(max_bounded)]
+        if force_inline_spec:
+            args += ['-Ppeval-pipeline-inline-spec']
+    else:
+        args += ['-Ppeval-policy=nospecialize']
+
+    out = ['']
+    progress = driver.previrt_progress(input_file, output_file, args, output=out,
+                                       may_crash=True)
+    if not driver.produced(output_file):
+        sys.stderr.write("ERROR: intra module pipeline failed!\n")
+        driver.copy(input_file, output_file)
+        return 1
+    if progress and log is not None:
+        log.write(out[0])
+    return 0
+
 def optimize(input_file, output_file, use_seaopt, extra_opts):
     """ Run opt -O3.
         The optimizer is tuned for code debloating and not necessarily
@@ -454,28 +521,124 @@ def config_prime(input_file, output_file, known_args, num_unknown_args):
     args.append('-Pconfig-prime-unknown-args={0}'.format(num_unknown_args))
     driver.previrt(input_file, output_file, args)
     
-def deep(libs, ifaces):
-    """ compute interfaces across modules.
+def defined_symbols(input_file):
+    """ The names of the symbols defined by a module, or None if unknown.
     """
-    tf = tempfile.NamedTemporaryFile(suffix='.iface', delete=False)
-    tf.close()
-    iface = inter.parseInterface(ifaces[0])
-    for i in ifaces[1:]:
-        inter.joinInterfaces(iface, inter.parseInterface(i))
-
-    inter.writeInterface(iface, tf.name)
+    sb = stringbuffer.StringBuffer()
+    retcode = driver.run('llvm-nm', ['-defined-only', input_file], sb, False)
+    if retcode != 0:
+        return None
+    names = set()
+    for line in str(sb).splitlines():
+        tokens = line.split()
+        if len(tokens) >= 2:
+            names.add(tokens[-1])
+    return names
+
+def join_interfaces(ifaces, output_file):
+    """ merges the interface files ifaces into output_file.
+
+    Returns whether the other interfaces added something to the first one.
+    """
+    sb = stringbuffer.StringBuffer()
+    args = ['-o', output_file]
+    if inter.flat_interfaces:
+        args.append('-Pflat-interfaces')
+    if inter.widen_limit > 0:
+        args.append('-Pinterface-widen={0}'.format(inter.widen_limit))
+    driver.run(config.get_occam_iface_join(), args + ifaces, sb)
+    return 'unchanged' not in str(sb)
+
+class Deep(object):
+    """ Computes the interfaces across modules.
+
+    The interface of a module only depends on the names of the functions
+    it defines that are called from the entry interface, so a module is
+    only gathered again when new calls to its functions show up. Each
+    round gathers all the pending modules in parallel.
+
+    The first round only depends on the initial interfaces, so it can run
+    for each module (gather) as soon as the module is ready. finish runs
+    the remaining rounds.
+    """
+    def __init__(self, ifaces):
+        self.ifaces = ifaces
+        self.tf = tempfile.NamedTemporaryFile(suffix='.iface', delete=False)
+        self.tf.close()
+        # The interface is always rebuilt from the initial interfaces and
+        # the latest interface of each module, which contains the
+        # earlier ones.
+        join_interfaces(ifaces, self.tf.name)
+        self.iface = inter.parseInterface(self.tf.name)
+        self.names = self.called()
+        self.lock = threading.Lock()
+        # [lib], in the order they were gathered first
+        self.libs = []
+        # lib -> output interface of its last gathering
+        self.outs = {}
+        # lib -> symbols defined by lib (None if unknown)
+        self.defined = {}
+        # lib -> the entries lib was last gathered with
+        self.asked = {}
+
+    def called(self):
+        return set([c.name for c in self.iface.calls])
+
+    def entries(self, l, names):
+        if self.defined[l] is None:
+            return frozenset(names)
+        return frozenset(names & self.defined[l])
+
+    def _gather(self, l):
+        interface(l, self.outs[l], [self.tf.name])
+
+    def gather(self, l):
+        """ Runs the first round on the module l.
+        """
+        of = tempfile.NamedTemporaryFile(suffix='.iface', delete=False)
+        of.close()
+        defined = defined_symbols(l)
+        with self.lock:
+            self.libs.append(l)
+            self.outs[l] = of.name
+            self.defined[l] = defined
+            self.asked[l] = self.entries(l, self.names)
+        self._gather(l)
+
+    def finish(self):
+        """ Runs the remaining rounds and returns the interface.
+        """
+        def _gather(l):
+            "Gathering module interfaces"
+            self._gather(l)
+
+        libs = sorted(self.libs)
+        worklist = libs
+        while True:
+            join_interfaces(self.ifaces + [self.outs[l] for l in libs], self.tf.name)
+            self.iface = inter.parseInterface(self.tf.name)
+            names = self.called()
+            worklist = [l for l in libs if self.entries(l, names) != self.asked[l]]
+            if not worklist:
+                break
+            for l in worklist:
+                self.asked[l] = self.entries(l, names)
+            pool.InParallel(_gather, worklist)
 
-    progress = True
-    while progress:
-        progress = False
+        os.unlink(self.tf.name)
         for l in libs:
-            interface(l, tf.name, [tf.name])
-            x = inter.parseInterface(tf.name)
-            progress = inter.joinInterfaces(iface, x) or progress
-            inter.writeInterface(iface, tf.name)
+            os.unlink(self.outs[l])
+        return self.iface
 
-    os.unlink(tf.name)
-    return iface
+def deep(libs, ifaces):
+    """ compute interfaces across modules.
+    """
+    d = Deep(ifaces)
+    def _gather(l):
+        "Gathering module interfaces"
+        d.gather(l)
+    pool.InParallel(_gather, libs)
+    return d.finish()
 
 # Try to prove that fname is unreachable with a timeout and a memory limit.
 # The flag is_loop_free indicates whether bounded model
@@ -575,7 +738,7 @@ def mc_dce(input_file,
     sea_cmd = utils.get_seahorn()
     if sea_cmd is None:
         sys.stderr.write('SeaHorn not found: skipped model-checking-based dce.')
-        shutil.copy(input_file, output_file)
+        driver.copy(input_file, output_file)
         return False
         
     cost_benefit_out = tempfile.NamedTemporaryFile(delete=False)
@@ -618,6 +781,6 @@ def mc_dce(input_file,
                            opt_options)
         change = change | (curfile <> nextfile)
         curfile = nextfile
-    shutil.copy(curfile, output_file)
+    driver.copy(curfile, output_file)
     return change
 
@@ -0,0 +1,248 @@
+"""
+ OCCAM
+
+ Copyright (c) 2011-2020, SRI International
+
+  All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+ * Neither the name of SRI International nor the names of its contributors may
+   be used to endorse or promote products derived from this software without
+   specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+ Persistent pass driver.
+
+ Instead of launching one opt process per OCCAM pass, each thread
+ talks to its own long-lived occam-driver process (src/tools) that
+ keeps the modules in memory. Modules produced by the driver are only
+ written to disk at checkpoints, or when some other tool needs them.
+
+"""
+import os
+import subprocess
+import threading
+import logging
+
+from . import config
+
+class DriverError(Exception):
+    def __init__(self, msg, dead=False):
+        Exception.__init__(self)
+        self._msg = msg
+        # the process is gone, with the modules it held in memory
+        self.dead = dead
+
+    def __str__(self):
+        return 'occam-driver: {0}'.format(self._msg)
+
+class DriverSession(object):
+    """ A connection to one occam-driver process.
+    """
+    def __init__(self, libs, logfile):
+        # other threads sync and drop the modules this session holds:
+        # one request at a time on the pipe
+        self._lock = threading.Lock()
+        self._log = open(logfile, 'a')
+        self._proc = subprocess.Popen([config.get_occam_driver()],
+                                      stdin=subprocess.PIPE,
+                                      stdout=subprocess.PIPE,
+                                      stderr=self._log)
+        self.request('load', libs)
+
+    def request(self, cmd, operands):
+        """ Sends a request and returns the words of the answer.
+        """
+        msg = '\n'.join([cmd] + operands) + '\n\n'
+        with self._lock:
+            try:
+                self._proc.stdin.write(msg)
+                self._proc.stdin.flush()
+                answer = self._proc.stdout.readline()
+            except IOError:
+                answer = ''
+        if not answer:
+            raise DriverError('died while processing "{0}"'.format(' '.join([cmd] + operands)),
+                              dead=True)
+        words = answer.split()
+        if words[0] != 'ok':
+            raise DriverError(answer[len('error '):].strip())
+        return words[1:]
+
+    def run(self, fin, fout, args, log=''):
+        """ Runs the passes in args. Returns whether they made progress.
+        """
+        # an empty operand would end the request
+        words = self.request('run', [fin, fout, log if log else '-'] + args)
+        return words == ['progress']
+
+    def close(self):
+        try:
+            self.request('quit', [])
+        except DriverError:
+            pass
+        self._proc.wait()
+        self._log.close()
+
+    def kill(self):
+        if self._proc.poll() is None:
+            self._proc.kill()
+        self._proc.wait()
+        self._log.close()
+
+
+# All the sessions
+_sessions = []
+# The session of each thread
+_local = threading.local()
+# Maps the files that only exist in memory to the session holding them
+_owners = {}
+_lock = threading.Lock()
+_work_dir = None
+
+def enable(work_dir):
+    """ Routes driver.previrt through occam-driver processes.
+    """
+    global _work_dir
+    _work_dir = work_dir
+
+def enabled():
+    return _work_dir is not None
+
+def _session():
+    s = getattr(_local, 'session', None)
+    if s is None:
+        libs = [config.get_sea_dsalib(),
+                config.get_llvm_dsalib(),
+                config.get_occamlib()]
+        with _lock:
+            logfile = os.path.join(_work_dir,
+                                   'occam-driver.{0}.log'.format(len(_sessions)))
+            s = DriverSession(libs, logfile)
+            _sessions.append(s)
+        _local.session = s
+    return s
+
+def sync(paths):
+    """ Makes sure that the files in paths are on disk.
+    """
+    for p in paths:
+        with _lock:
+            owner = _owners.get(p)
+        if owner is not None:
+            # p stays in memory until it is written, so that another
+            # thread syncing it at the same time waits for it too
+            owner.request('sync', [p])
+            with _lock:
+                if _owners.get(p) is owner:
+                    del _owners[p]
+
+def discard(paths):
+    """ The files in paths are not needed anymore.
+    """
+    for p in paths:
+        with _lock:
+            owner = _owners.pop(p, None)
+        if owner is not None:
+            owner.request('drop', [p])
+
+def holds(path):
+    """ Whether path only exists in memory.
+    """
+    with _lock:
+        return path in _owners
+
+def previrt(fin, fout, args, log=''):
+    """ Runs OCCAM passes on fin and leaves the result (in memory) as fout.
+    """
+    s = _session()
+    with _lock:
+        owner = _owners.get(fin)
+    if owner is not None and owner is not s:
+        # fin is held by another thread's driver
+        sync([fin])
+    logging.getLogger().info('EXECUTING (occam-driver): %s %s -o=%s\n',
+                             ' '.join(args), fin, fout)
+    progress = s.run(fin, fout, args, log)
+    with _lock:
+        if fout != '/dev/null':
+            _owners[fout] = s
+            if fin != fout and _owners.get(fin) is s:
+                # the driver moved the module from fin to fout
+                del _owners[fin]
+    return progress
+
+def save():
+    """ Writes to disk the modules that only exist in the memory of this
+        thread's driver, so that they survive a crash of the next pass.
+    """
+    s = _session()
+    with _lock:
+        for p in [p for (p, o) in _owners.items() if o is s]:
+            del _owners[p]
+    s.request('sync-all', [])
+
+def restart():
+    """ Stops this thread's driver after it died. The next request starts
+        a new one.
+
+        Returns the files that only existed in its memory. They are lost,
+        and their copies on disk (if any) are older so they are removed.
+    """
+    s = getattr(_local, 'session', None)
+    if s is None:
+        return []
+    _local.session = None
+    with _lock:
+        if s in _sessions:
+            _sessions.remove(s)
+        lost = [p for (p, o) in _owners.items() if o is s]
+        for p in lost:
+            del _owners[p]
+    s.kill()
+    for p in lost:
+        if os.path.isfile(p):
+            os.unlink(p)
+    return lost
+
+def checkpoint():
+    """ Writes every module that only exists in memory to disk.
+    """
+    with _lock:
+        sessions = list(_sessions)
+        _owners.clear()
+    for s in sessions:
+        s.request('sync-all', [])
+
+def shutdown():
+    """ Writes everything to disk and stops all the drivers.
+    """
+    if not enabled():
+        return
+    checkpoint()
+    with _lock:
+        sessions = list(_sessions)
+        del _sessions[:]
+    for s in sessions:
+        s.close()
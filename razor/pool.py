@@ -1,7 +1,7 @@
 """
  OCCAM
 
- Copyright (c) 2011-2017, SRI International
+ Copyright (c) 2011-2020, SRI International
 
   All rights reserved.
 
@@ -33,12 +33,34 @@
 
  Thread pool for processing modules in parallel.
 
+ Tasks are scheduled longest-first, so that a single large module does
+ not end up running alone at the tail of a stage. The expected cost of a
+ task is the time it took in the previous stage, or the size of its
+ bitcode file when there is no previous timing.
+
+ A pool can also be given a memory budget. A task is then only started
+ while the estimated peak RSS of the running tasks plus its own stays
+ under the budget, so that large modules run alone and small ones run
+ concurrently. The peak RSS of a task is the largest peak RSS of the
+ processes it ran the last time the module was processed, in this run
+ or in the trace of an earlier one, or else the size of its bitcode
+ times the largest RSS/size ratio seen so far.
+
+ Stages can be expressed as a TaskGraph, where a task only waits for
+ the tasks it depends on instead of a barrier after every stage. map
+ runs a graph without dependencies.
+
 """
 from Queue import Queue
+import multiprocessing
+import os
 import threading
+import time
 import traceback
 import sys
 
+from . import trace
+
 class Worker(threading.Thread):
     """ A daemon worker thread.
     """
@@ -56,30 +78,181 @@ class Worker(threading.Thread):
             f()
 
 
+# Peak RSS per byte of bitcode assumed before any task has been measured
+DEFAULT_RSS_RATIO = 40
+# Smaller modules say more about opt than about the module itself
+MIN_RATIO_SIZE = 1024 * 1024
+
+def cpuCount():
+    try:
+        return multiprocessing.cpu_count()
+    except NotImplementedError:
+        return 1
+
+def taskFile(arg):
+    """ Returns (name, path) of the module a task argument refers to.
+
+        Arguments are versioned files, or tuples containing one.
+    """
+    if isinstance(arg, (tuple, list)):
+        for x in arg:
+            r = taskFile(x)
+            if r is not None:
+                return r
+        return None
+    base = getattr(arg, '_base', None)
+    if base is not None:
+        return (base, arg.get())
+    if isinstance(arg, str) and os.path.isfile(arg):
+        return (arg, arg)
+    return None
+
+
+class TaskGraph(object):
+    """ Tasks with dependencies between them.
+    """
+    def __init__(self):
+        # [(f, arg, [task])]
+        self.tasks = []
+
+    def add(self, f, arg, deps=()):
+        """ Adds the task f(arg), run after the tasks in deps. Returns its id.
+        """
+        self.tasks.append((f, arg, list(deps)))
+        return len(self.tasks) - 1
+
+    def __len__(self):
+        return len(self.tasks)
+
+
 class ThreadPool(object):
     """ A pool of daemon worker threads.
     """
-    def __init__(self, count=3):
+    def __init__(self, count=None):
         """ Initializes a pool queue.
         """
         self.queue = Queue()
         self.workers = None
+        if count is None or count < 1:
+            count = cpuCount()
         self.count = count
+        # name -> seconds taken by the last task on that module
+        self.history = {}
+        # [(name, seconds)] of the last run
+        self.timings = []
+        # memory budget in bytes (None: unlimited)
+        self.budget = None
+        # name -> peak RSS in bytes of the last task on that module
+        self.rss_history = {}
+        # module file name -> peak RSS in bytes in an earlier run
+        self.rss_trace = {}
+        # estimated peak RSS per byte of bitcode
+        self.rss_ratio = DEFAULT_RSS_RATIO
 
     def _start(self):
         if self.workers is None:
-            self.workers = [Worker(self.queue)]
-            for w in self.workers:
-                w.start()
+            self.workers = []
+        while len(self.workers) < self.count:
+            w = Worker(self.queue)
+            self.workers.append(w)
+            w.start()
+
+    def resize(self, count):
+        """ Sets the number of workers. Running workers are never stopped.
+        """
+        if count >= 1:
+            self.count = count
+
+    def set_budget(self, mb):
+        """ Limits the estimated memory used by concurrent tasks to mb MB.
+        """
+        self.budget = mb * 1024 * 1024
+
+    def load_history(self, filename):
+        """ Seeds the memory estimates with the tasks of an earlier trace.
+        """
+        for (module, (rss, size)) in trace.history(filename).items():
+            self.rss_trace[module] = rss
+            self._learn_ratio(rss, size)
+
+    def _learn_ratio(self, rss, size):
+        if rss > 0 and size >= MIN_RATIO_SIZE:
+            self.rss_ratio = max(self.rss_ratio, rss / size)
+
+    def _estimate(self, name, size):
+        """ Estimated peak RSS in bytes of a task.
+        """
+        if name is not None and name in self.rss_history:
+            return self.rss_history[name]
+        if name is not None and os.path.basename(name) in self.rss_trace:
+            return self.rss_trace[os.path.basename(name)]
+        return size * self.rss_ratio
+
+    @staticmethod
+    def _describe(arg):
+        """ Returns the (name, size) of the module of a task argument.
+        """
+        tf = taskFile(arg)
+        if tf is None:
+            return (None, 0)
+        (name, path) = tf
+        try:
+            return (name, os.path.getsize(path))
+        except OSError:
+            return (name, 0)
+
+    def _order(self, ready, names, sizes):
+        """ Sorts the ready tasks in decreasing order of expected cost.
+        """
+        # Timings and sizes are not comparable: only trust the history
+        # when it covers every task.
+        if all(names[i] is not None and names[i] in self.history for i in ready):
+            cost = lambda i: self.history[names[i]]
+        else:
+            cost = lambda i: sizes[i]
+        ready.sort(key=cost, reverse=True)
 
     def map(self, f, args):
+        graph = TaskGraph()
+        for a in args:
+            graph.add(f, a)
+        return self.run(graph)
+
+    def run(self, graph):
+        """ Runs the tasks of graph and returns their results.
+
+        A task is started as soon as the tasks it depends on are done,
+        the longest first, and only while the memory budget allows it.
+        """
+        tasks = graph.tasks
+        n = len(tasks)
         self._start()
-        result = [None for i in range(0, len(args))]
-        sem = threading.Semaphore(0)
+        result = [None for i in range(0, n)]
+        timings = [None for i in range(0, n)]
+        rss = [0 for i in range(0, n)]
+        names = [None for i in range(0, n)]
+        sizes = [0 for i in range(0, n)]
+        estimates = [0 for i in range(0, n)]
+        described = [False for i in range(0, n)]
+        dependents = [[] for i in range(0, n)]
+        waiting = [len(deps) for (_, _, deps) in tasks]
+        for i in range(0, n):
+            for d in tasks[i][2]:
+                dependents[d].append(i)
+        ready = [i for i in range(0, n) if waiting[i] == 0]
+        order = []
+        # protects ready, waiting, used and done
+        cond = threading.Condition()
+        state = {'used' : 0, 'done' : 0}
         def func(i):
+            (f, arg, _) = tasks[i]
             def rf():
+                start = time.time()
+                module = os.path.basename(names[i]) if names[i] else None
+                trace.task_start()
                 try:
-                    result[i] = f(args[i])
+                    with trace.annotate(stage=f.func_doc, module=module):
+                        result[i] = f(arg)
                 except Exception:
                     seperator = '-' * 60
                     print("Exception in worker for {0}:".format(f.func_doc))
@@ -88,30 +261,99 @@ class ThreadPool(object):
                     print(seperator)
                     sys.exit(1)  #iam: was _exit; but are we really that low level?
                 finally:
-                    sem.release()
+                    timings[i] = time.time() - start
+                    rss[i] = trace.task_maxrss()
+                    trace.record(f.func_doc, start, start + timings[i],
+                                 kind='task', stage=f.func_doc,
+                                 module=module, rss=rss[i], size=sizes[i])
+                    with cond:
+                        state['used'] -= estimates[i]
+                        state['done'] += 1
+                        for j in dependents[i]:
+                            waiting[j] -= 1
+                            if waiting[j] == 0:
+                                ready.append(j)
+                        cond.notify_all()
             return rf
-        for i in range(0, len(args)):
-            self.queue.put(func(i))
-        for _ in args:
-            sem.acquire(True)
+        with cond:
+            while len(order) < n:
+                # the modules of the ready tasks are known by now
+                for i in ready:
+                    if not described[i]:
+                        (names[i], sizes[i]) = self._describe(tasks[i][1])
+                        estimates[i] = self._estimate(names[i], sizes[i])
+                        described[i] = True
+                self._order(ready, names, sizes)
+                # the first task that fits, or any task if nothing is
+                # running
+                fits = [i for i in ready
+                        if self.budget is None or state['used'] == 0 or
+                        state['used'] + estimates[i] <= self.budget]
+                if not fits:
+                    cond.wait()
+                    continue
+                i = fits[0]
+                ready.remove(i)
+                order.append(i)
+                state['used'] += estimates[i]
+                self.queue.put(func(i))
+            while state['done'] < n:
+                cond.wait()
+        self.timings = []
+        for i in order:
+            (f, arg, _) = tasks[i]
+            name = names[i] if names[i] is not None else str(arg)
+            if names[i] is not None:
+                self.history[names[i]] = timings[i]
+                if rss[i] > 0:
+                    self.rss_history[names[i]] = rss[i]
+            self._learn_ratio(rss[i], sizes[i])
+            self.timings.append((f.func_doc, name, timings[i]))
         return result
 
     def shutdown(self):
         pass
 
-POOL = ThreadPool(3)
+POOL = ThreadPool()
 
 def getDefaultPool():
     return POOL
 
+def _report(pool, start, stages):
+    sys.stderr.write("done in %.2fs with %d worker(s)\n" %
+                     (time.time() - start, pool.count))
+    for (doc, name, secs) in sorted(pool.timings, key=lambda t: t[2], reverse=True):
+        if stages:
+            sys.stderr.write("\t%8.2fs  %s: %s\n" % (secs, doc, os.path.basename(name)))
+        else:
+            sys.stderr.write("\t%8.2fs  %s\n" % (secs, os.path.basename(name)))
+
 def InParallel(f, args, pool=None):
     import datetime
     dt = datetime.datetime.now ().strftime ('%d/%m/%Y %H:%M:%S')
     sys.stderr.write("[%s] Starting %s...\n" % (dt, f.func_doc))
     if pool is None:
         pool = getDefaultPool()
+    start = time.time()
     result = pool.map(f, args)
-    sys.stderr.write("done\n")
+    _report(pool, start, False)
+    return result
+
+def InGraph(graph, pool=None):
+    """ Runs the tasks of graph, and returns their results.
+    """
+    import datetime
+    dt = datetime.datetime.now ().strftime ('%d/%m/%Y %H:%M:%S')
+    docs = []
+    for (f, _, _) in graph.tasks:
+        if f.func_doc not in docs:
+            docs.append(f.func_doc)
+    sys.stderr.write("[%s] Starting %s...\n" % (dt, ', '.join(docs)))
+    if pool is None:
+        pool = getDefaultPool()
+    start = time.time()
+    result = pool.run(graph)
+    _report(pool, start, True)
     return result
 
 
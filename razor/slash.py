@@ -48,6 +48,10 @@ from . import pool
 
 from . import driver
 
+from . import cache
+
+from . import trace
+
 from . import config
 
 instructions = """slash has three modes of use:
@@ -77,13 +81,18 @@ instructions = """slash has three modes of use:
         --devirt=<type>            : Devirtualize indirect function calls 
                                      (<type> should be either none, dsa, sea_dsa or cha_dsa)
         --intra-spec-policy=<type> : Specialization policy for intramodule calls 
-                                     (<type> should be either none, aggressive, nonrec-aggressive, bounded, or onlyonce)
+                                     (<type> should be either none, aggressive, nonrec-aggressive, recursive, bounded, onlyonce, cost-benefit, or profile)
         --inter-spec-policy=<type> : Specialization policy for intermodule calls 
-                                     (<type> should be either none, aggressive, nonrec-aggressive, bounded, or onlyonce)
-        --max-bounded-spec=N       : Maximum number of function specialization if spec policy is bounded
+                                     (<type> should be either none, aggressive, nonrec-aggressive, recursive, bounded, onlyonce, cost-benefit, or profile)
+        --max-bounded-spec=N       : Maximum number of function specialization if spec policy is bounded,
+                                     or of copies of a recursive function on varying arguments if it is recursive
+        --spec-profile=<file>      : Value profile (lines "<file>:<line>[:<column>] <callee> <arg index> <value> <count>") if spec policy is profile
         --disable-inlining         : Disable inlining
         --force-inline-bounce      : Force inlining of bounce functions generated by devirt
         --force-inline-spec        : Force inlining of functions generated by specialization
+        --hashed-spec-names        : Name specialized functions by a hash of their arguments instead of spelling them out
+        --flat-interfaces          : Write the interface and rewrite files in the flat (memory-mapped) format instead of protobuf
+        --interface-widen=N        : Widen the arguments that vary once a function has more than N distinct calls in an interface
         --keep-external=<file>     : Pass a list of function names that should remain external.
         --enable-config-prime      : Enable dynamic analysis to propagate manifest data (experimental)
         --llpe                     : Use Smowton's LLPE for intra-module prunning (experimental)
@@ -91,6 +100,13 @@ instructions = """slash has three modes of use:
         --mc-dce                   : Use model-checking to perform intra-module dead code elimination (experimental)
         --ai-dce                   : Use invariants inferred by abstract interpretation for intra-module dce (experimental)
         --amalgamate=<file>        : Amalgamate the bitcode into a single <file> before linking (used to deal with duplicate symbols)
+        --cache-dir=<dir>          : Cache the results of the OCCAM passes in <dir>, across iterations and runs
+        --cache-size=<n>           : Maximum size in MB of the pass cache (default: 1024)
+        --max-fixpoint-iterations=<n> : Maximum number of iterations of the global fixpoint (default: 10)
+        --trace                    : Record the time and memory of every tool run in <work-dir>/slash.trace.json (Chrome trace format)
+        --jobs=<n>                 : Number of modules processed in parallel (default: number of cores)
+        --memory-budget=<n>        : Only run modules in parallel while their estimated memory stays under <n> MB (estimated from the trace of an earlier --trace run if any)
+        --persistent-driver        : Run the OCCAM passes in long-lived occam-driver processes that keep the modules in memory
     """
 
 def entrypoint():
@@ -107,7 +123,7 @@ def entrypoint():
 
 
 def  usage(exe):
-    template = '{0} [--work-dir=<dir>]  [--force] [--help] [--stats] [--opt-stats] [--no-strip] [--verbose] [--debug-manager=] [--debug-pass=] [--debug] [--print-after-all] [--devirt=<type>] [--intra-spec-policy=<type>] [--inter-spec-policy=<type>] [--max-bounded-spec=N] [--disable-inlining] [--force-inline-bounce] [--force-inline-spec] [--keep-external=<file>] [--enable-config-prime] [--llpe] [--ipdse] [--mc-dce] [--ai-dce] <manifest>\n'
+    template = '{0} [--work-dir=<dir>]  [--force] [--help] [--stats] [--opt-stats] [--no-strip] [--verbose] [--debug-manager=] [--debug-pass=] [--debug] [--print-after-all] [--devirt=<type>] [--intra-spec-policy=<type>] [--inter-spec-policy=<type>] [--max-bounded-spec=N] [--spec-profile=<file>] [--disable-inlining] [--force-inline-bounce] [--force-inline-spec] [--hashed-spec-names] [--flat-interfaces] [--interface-widen=N] [--keep-external=<file>] [--enable-config-prime] [--llpe] [--ipdse] [--mc-dce] [--ai-dce] [--amalgamate=<file>] [--cache-dir=<dir>] [--cache-size=<n>] [--jobs=<n>] [--memory-budget=<n>] [--max-fixpoint-iterations=<n>] [--trace] [--persistent-driver] <manifest>\n'
     sys.stderr.write(template.format(exe))
 
 class Slash(object):
@@ -136,13 +152,24 @@ class Slash(object):
                         'intra-spec-policy=',
                         'inter-spec-policy=',
                         'max-bounded-spec=',
+                        'spec-profile=',
                         'disable-inlining',
                         'force-inline-bounce',
                         'force-inline-spec',
+                        'hashed-spec-names',
+                        'flat-interfaces',
+                        'interface-widen=',
                         'tool=',
                         'verbose',
                         'keep-external=',
-                        'amalgamate=']
+                        'amalgamate=',
+                        'cache-dir=',
+                        'cache-size=',
+                        'jobs=',
+                        'memory-budget=',
+                        'max-fixpoint-iterations=',
+                        'trace',
+                        'persistent-driver']
             parsedargs = getopt.getopt(argv[1:], None, cmdflags)
             (self.flags, self.args) = parsedargs
 
@@ -178,6 +205,33 @@ class Slash(object):
 
         self.work_dir = utils.get_work_dir(self.flags)
         self.pool = pool.getDefaultPool()
+        if utils.get_flag(self.flags, 'jobs') is not None:
+            jobs = utils.get_jobs(self.flags)
+            if jobs is None or jobs < 1:
+                print('The number of jobs must be a positive integer.')
+                self.valid = False
+                return
+            self.pool.resize(jobs)
+        if utils.get_flag(self.flags, 'memory-budget') is not None:
+            budget = utils.get_memory_budget(self.flags)
+            if budget is None or budget < 1:
+                print('The memory budget must be a positive number of MB.')
+                self.valid = False
+                return
+            self.pool.set_budget(budget)
+            # the trace of an earlier run gives the memory of each module
+            self.pool.load_history(os.path.join(self.work_dir, 'slash.trace.json'))
+        self.max_fixpoint_iterations = 10
+        iterations = utils.get_flag(self.flags, 'max-fixpoint-iterations', None)
+        if iterations is not None:
+            try:
+                self.max_fixpoint_iterations = int(iterations)
+            except ValueError:
+                self.max_fixpoint_iterations = 0
+            if self.max_fixpoint_iterations < 1:
+                print('The maximum number of fixpoint iterations must be a positive integer.')
+                self.valid = False
+                return
         self.valid = True
         self.amalgamation = utils.get_amalgamation(self.flags)
 
@@ -195,15 +249,18 @@ class Slash(object):
             return 1
 
         def check_spec_policy(policy):
-            """ Supported policies: none, aggressive, nonrec-aggressive, bounded or onlyonce """
+            """ Supported policies: none, aggressive, nonrec-aggressive, recursive, bounded, onlyonce, cost-benefit or profile """
 
             if policy <> 'none' and \
                policy <> 'aggressive' and \
                policy <> 'bounded' and \
                policy <> 'onlyonce' and \
+               policy <> 'cost-benefit' and \
+               policy <> 'profile' and \
+               policy <> 'recursive' and \
                policy <> 'nonrec-aggressive':
                 sys.stderr.write('Error: unsupported specialization policy. ' + \
-                                 'Valid policies: none, aggressive, nonrec-aggressive, bounded, onlyonce')
+                                 'Valid policies: none, aggressive, nonrec-aggressive, recursive, bounded, onlyonce, cost-benefit, profile')
                 return False
             else:
                 return True
@@ -432,9 +489,12 @@ class Slash(object):
 
         utils.write_timestamp("Started global fixpoint ...")
         iteration = 0
-        max_fixpoint_iterations = 10 ## make this user parameter
+        max_fixpoint_iterations = self.max_fixpoint_iterations
+        # the fixpoint is reached as soon as no module changes
+        hashes = dict([(m, driver.module_hash(f.get())) for (m, f) in files.items()])
         while progress:
             iteration += 1
+            trace.set_iteration(iteration)
             if iteration > max_fixpoint_iterations:
                 sys.stderr.write('Fixpoint took more than ' + \
                                  str(max_fixpoint_iterations) + ". " + \
@@ -463,13 +523,28 @@ class Slash(object):
                              use_llpe, use_ipdse, use_ai_dce, \
                              log=open(fn, 'w'))
 
-            pool.InParallel(intra, files.values(), self.pool)
-
             ### 4. Gather Inter-module interfaces
-            iface = passes.deep([x.get() for x in files.values()],
-                                ['main.iface'])
+            # The first round of gathering the interface of a module
+            # starts as soon as the module has been specialized.
+            def gatherer(d):
+                def gather(m):
+                    "Gathering module interfaces"
+                    d.gather(m.get())
+                return gather
+
+            deep_before = passes.Deep(['main.iface'])
+            gather = gatherer(deep_before)
+            graph = pool.TaskGraph()
+            for m in files.values():
+                graph.add(gather, m, [graph.add(intra, m)])
+            pool.InGraph(graph, self.pool)
+            iface = deep_before.finish()
             interface.writeInterface(iface, iface_before_file.new())
 
+            deep_after = passes.Deep(['main.iface'])
+            graph = pool.TaskGraph()
+            rewrites = {}
+
             ### 5. Inter-specialize
             if inter_spec_policy <> 'none':
 
@@ -485,8 +560,8 @@ class Slash(object):
                 print "\tInter-specialization policy={0}".format(inter_spec_policy)
                 if inter_spec == 'bounded':
                     print "\tMax number of copies={0}".format(max_bounded_spec)
-                    
-                pool.InParallel(inter_spec, files.items(), self.pool)
+
+                specs = [graph.add(inter_spec, x) for x in files.items()]
 
                 # Rewrite
                 def inter_rewrite((nm, m)):
@@ -504,20 +579,29 @@ class Slash(object):
                     dbg.close()
                     return retcode
 
-                rws = pool.InParallel(inter_rewrite, files.items(), self.pool)
-                
-                progress = any(rws)
+                # a module is rewritten with the specifications of all
+                # the other modules
+                for (nm, m) in files.items():
+                    rewrites[nm] = graph.add(inter_rewrite, (nm, m), specs)
             else:
                 print "Skipped inter-module specialization"
 
-            # Aggressive internalization
-            pool.InParallel(_references, vals, self.pool)
-            pool.InParallel(_internalize, vals, self.pool)
+            # Aggressive internalization: a module is internalized with
+            # the references of all the other modules
+            references = [graph.add(_references, (nm, f),
+                                    [rewrites[nm]] if nm in rewrites else [])
+                          for (nm, f) in vals]
+            gather = gatherer(deep_after)
+            for (nm, f) in vals:
+                graph.add(gather, f, [graph.add(_internalize, (nm, f), references)])
+
+            results = pool.InGraph(graph, self.pool)
+            progress = any([results[t] for t in rewrites.values()])
 
             ### 6. Sealing
             
             # Compute the interfaces again after new specialized functions
-            iface = passes.deep([x.get() for x in files.values()], ['main.iface'])
+            iface = deep_after.finish()
             interface.writeInterface(iface, iface_after_file.new())
 
             # internalize 
@@ -529,6 +613,26 @@ class Slash(object):
                 
             pool.InParallel(sealing, files.values(), self.pool)
 
+            # Use the facts about the definitions of each module
+            # (constant return values, constant globals) in the others
+            def _facts(m):
+                "Propagating return values and constant globals"
+                pre = m.get()
+                post = m.new('f')
+                return passes.facts(pre, post, [iface_after_file.get()])
+
+            if any(pool.InParallel(_facts, files.values(), self.pool)):
+                progress = True
+
+            # Write the modules kept in memory by the persistent driver
+            driver.checkpoint()
+
+            new_hashes = dict([(m, driver.module_hash(f.get())) for (m, f) in files.items()])
+            if progress and new_hashes == hashes:
+                sys.stderr.write('No module changed in iteration {0}. Stopping fixpoint.\n'.format(iteration))
+                progress = False
+            hashes = new_hashes
+
         utils.write_timestamp("Finished global fixpoint.")
 
         # Strip everything
@@ -622,6 +726,10 @@ class Slash(object):
             else:
                 sys.stderr.write("ropgadget not found. Aborting model-checking-based dce ...")
 
+        driver.shutdown()
+        cache.report()
+        trace.write()
+
         # Make symlinks for the "final" versions
         for x in files.values():
             trg = x.base('-final')
@@ -675,8 +783,59 @@ class Slash(object):
         if print_after_all is not None:
             driver.opt_debug_cmds.append('--print-after-all')
 
+        spec_profile = utils.get_flag(self.flags, 'spec-profile', None)
+        if spec_profile is not None:
+            if not os.path.isfile(spec_profile):
+                print('The value profile {0} was not found.'.format(spec_profile))
+                return False
+            spec_profile = os.path.abspath(spec_profile)
+            driver.opt_debug_cmds.append('-Ppeval-profile={0}'.format(spec_profile))
+            driver.opt_debug_cmds.append('-Pspecialize-profile={0}'.format(spec_profile))
+
+        hashed_spec_names = utils.get_flag(self.flags, 'hashed-spec-names', None)
+        if hashed_spec_names is not None:
+            driver.opt_debug_cmds.append('-Pspec-hashed-names')
+
+        flat_interfaces = utils.get_flag(self.flags, 'flat-interfaces', None)
+        if flat_interfaces is not None:
+            driver.opt_debug_cmds.append('-Pflat-interfaces')
+            interface.flat_interfaces = True
+
+        interface_widen = utils.get_flag(self.flags, 'interface-widen', None)
+        if interface_widen is not None:
+            try:
+                interface_widen = int(interface_widen)
+            except ValueError:
+                interface_widen = 0
+            if interface_widen < 1:
+                print('The interface widening limit must be a positive integer.')
+                return False
+            driver.opt_debug_cmds.append('-Pinterface-widen={0}'.format(interface_widen))
+            interface.widen_limit = interface_widen
+
         verbose = utils.get_flag(self.flags, 'verbose', None)
         if verbose is not None:
             driver.verbose = True
 
+        persistent_driver = utils.get_flag(self.flags, 'persistent-driver', None)
+        if persistent_driver is not None:
+            occam_driver = config.get_occam_driver()
+            if occam_driver is None or not os.path.exists(occam_driver):
+                print('The occam-driver executable was not found.')
+                return False
+            driver.persistent.enable(self.work_dir)
+
+        if utils.get_flag(self.flags, 'trace', None) is not None:
+            trace.enable(os.path.join(self.work_dir, 'slash.trace.json'))
+
+        cache_dir = utils.get_flag(self.flags, 'cache-dir', None)
+        if cache_dir is not None:
+            cache_size = utils.get_flag(self.flags, 'cache-size', '1024')
+            try:
+                cache_size = int(cache_size)
+            except ValueError:
+                print('The cache size must be a number of MB.')
+                return False
+            cache.enable(os.path.abspath(cache_dir), cache_size)
+
         return True
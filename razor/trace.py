@@ -0,0 +1,236 @@
+"""
+ OCCAM
+
+ Copyright (c) 2011-2020, SRI International
+
+  All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+ * Neither the name of SRI International nor the names of its contributors may
+   be used to endorse or promote products derived from this software without
+   specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+
+ Execution trace of a slash run.
+
+ Every tool invocation (opt, the OCCAM passes, clang, ...) and every
+ pool task is recorded with its wall time, the user/sys CPU time and
+ peak RSS of the process (from wait4), the module and pass involved,
+ the fixpoint iteration and the cache status. The records are written
+ in the Chrome trace event format, which chrome://tracing and Perfetto
+ can display, and summarized per stage and module.
+
+"""
+import json
+import os
+import sys
+import threading
+import time
+
+_file = None
+_start = None
+_events = []
+_lock = threading.Lock()
+_local = threading.local()
+_threads = {}
+_iteration = 0
+
+def enable(filename):
+    """ Records the trace of this run into filename.
+    """
+    global _file, _start
+    _file = filename
+    _start = time.time()
+
+def enabled():
+    return _file is not None
+
+def set_iteration(n):
+    """ Sets the current fixpoint iteration.
+    """
+    global _iteration
+    _iteration = n
+
+class annotate(object):
+    """ Adds attributes to the records of this thread within a with block.
+    """
+    def __init__(self, **attrs):
+        self._attrs = attrs
+        self._saved = None
+
+    def __enter__(self):
+        self._saved = getattr(_local, 'attrs', {})
+        attrs = dict(self._saved)
+        attrs.update(self._attrs)
+        _local.attrs = attrs
+
+    def __exit__(self, *exc):
+        _local.attrs = self._saved
+        return False
+
+def _tid():
+    t = threading.current_thread()
+    with _lock:
+        if t.ident not in _threads:
+            _threads[t.ident] = (len(_threads), t.name)
+        return _threads[t.ident][0]
+
+def describe(prog, args):
+    """ Returns the (file, pass) of a tool invocation.
+    """
+    module = None
+    for a in args:
+        if os.path.splitext(a)[1] in ['.bc', '.ll', '.o', '.a']:
+            module = os.path.basename(a)
+            break
+    name = None
+    for a in args:
+        if a.startswith('-P') or a.startswith('--P') or \
+           (a.startswith('-O') and len(a) <= 3):
+            name = a.lstrip('-').split('=')[0]
+            break
+    if name is None:
+        name = os.path.basename(prog)
+    return (module, name)
+
+def record(name, start, end, rusage=None, **attrs):
+    """ Records an event that ran between start and end (time.time()).
+    """
+    if not enabled():
+        return
+    args = dict(getattr(_local, 'attrs', {}))
+    args.update([(k, v) for (k, v) in attrs.items() if v is not None])
+    if args.get('module') is None and 'file' in args:
+        # outside of a pool task, the module is the file being processed
+        args['module'] = args['file']
+    args['iteration'] = _iteration
+    if rusage is not None:
+        args['user'] = rusage.ru_utime
+        args['sys'] = rusage.ru_stime
+        # kilobytes on Linux, bytes on Darwin
+        args['maxrss'] = rusage.ru_maxrss
+    event = {'name' : name,
+             'cat' : args.get('stage', 'slash'),
+             'ph' : 'X',
+             'ts' : int((start - _start) * 1e6),
+             'dur' : int((end - start) * 1e6),
+             'pid' : os.getpid(),
+             'tid' : _tid(),
+             'args' : args}
+    with _lock:
+        _events.append(event)
+
+def wait(proc):
+    """ Waits for the subprocess proc and returns its rusage.
+
+    The peak RSS of proc is also accounted to the current task of the
+    calling thread (see task_maxrss), even if the trace is disabled.
+    """
+    while True:
+        try:
+            (_, status, rusage) = os.wait4(proc.pid, 0)
+            break
+        except OSError as e:
+            if e.errno != 4: # EINTR
+                raise
+    if os.WIFSIGNALED(status):
+        proc.returncode = -os.WTERMSIG(status)
+    else:
+        proc.returncode = os.WEXITSTATUS(status)
+    _local.maxrss = max(getattr(_local, 'maxrss', 0), rss_bytes(rusage))
+    return rusage
+
+def rss_bytes(rusage):
+    """ The peak RSS of rusage in bytes.
+    """
+    if sys.platform == 'darwin':
+        return rusage.ru_maxrss
+    return rusage.ru_maxrss * 1024
+
+def task_start():
+    """ Starts measuring the peak RSS of the processes run by this thread.
+    """
+    _local.maxrss = 0
+
+def task_maxrss():
+    """ Largest peak RSS in bytes of the processes run since task_start.
+    """
+    return getattr(_local, 'maxrss', 0)
+
+def history(filename):
+    """ Returns {module: (peak RSS in bytes, bitcode size)} of the pool
+    tasks recorded in an earlier trace file, or {} if there is none.
+    """
+    try:
+        with open(filename, 'r') as fd:
+            events = json.load(fd).get('traceEvents', [])
+    except (IOError, ValueError):
+        return {}
+    modules = {}
+    for e in events:
+        args = e.get('args', {})
+        if args.get('kind') <> 'task' or not args.get('module'):
+            continue
+        (rss, size) = modules.get(args['module'], (0, 0))
+        modules[args['module']] = (max(rss, args.get('rss', 0)),
+                                   max(size, args.get('size', 0)))
+    return dict([(m, v) for (m, v) in modules.items() if v[0] > 0])
+
+def summary(out=sys.stderr, rows=20):
+    """ Prints the stage/module pairs that took the longest.
+    """
+    table = {}
+    for e in _events:
+        args = e['args']
+        if args.get('kind') == 'task':
+            continue
+        k = (args.get('stage', '-'), args.get('module') or '-')
+        r = table.setdefault(k, [0, 0.0, 0.0, 0, 0])
+        r[0] += 1
+        r[1] += e['dur'] / 1e6
+        r[2] += args.get('user', 0.0) + args.get('sys', 0.0)
+        r[3] = max(r[3], args.get('maxrss', 0))
+        r[4] += 1 if args.get('cache') == 'hit' else 0
+    out.write('\n{0:<40} {1:<30} {2:>5} {3:>10} {4:>10} {5:>10} {6:>5}\n'.format(
+        'stage', 'module', 'runs', 'wall(s)', 'cpu(s)', 'maxrss', 'hits'))
+    for (k, r) in sorted(table.items(), key=lambda x: x[1][1], reverse=True)[:rows]:
+        out.write('{0:<40} {1:<30} {2:>5} {3:>10.2f} {4:>10.2f} {5:>10} {6:>5}\n'.format(
+            k[0][:40], k[1][:30], r[0], r[1], r[2], r[3], r[4]))
+
+def write():
+    """ Writes the trace file and prints the summary.
+    """
+    if not enabled():
+        return
+    with _lock:
+        events = list(_events)
+        threads = dict(_threads)
+    for (tid, name) in threads.values():
+        events.append({'name' : 'thread_name', 'ph' : 'M', 'pid' : os.getpid(),
+                       'tid' : tid, 'args' : {'name' : name}})
+    with open(_file, 'w') as fd:
+        json.dump({'traceEvents' : events, 'displayTimeUnit' : 'ms'}, fd)
+    summary()
+    sys.stderr.write('Trace written to {0}\n'.format(_file))
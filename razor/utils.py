@@ -74,6 +74,26 @@ def get_amalgamation(flags):
     return None
 
 
+def get_jobs(flags):
+    jobs = get_flag(flags, 'jobs')
+    if jobs is None:
+        return None
+    try:
+        return int(jobs)
+    except ValueError:
+        return None
+
+
+def get_memory_budget(flags):
+    budget = get_flag(flags, 'memory-budget')
+    if budget is None:
+        return None
+    try:
+        return int(budget)
+    except ValueError:
+        return None
+
+
 def get_manifest(args):
     manifest = None
     if not args:
@@ -32,6 +32,8 @@
 //
 
 #include "BoundedSpecPolicy.h"
+#include "Specializer.h"
+#include "SpecializationTable.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -50,20 +52,29 @@ namespace previrt {
     : m_subpolicy(std::move(subpolicy))
     , m_threshold(threshold) {
 
-    // HACK: slash can run the specializer on the same module multiple
-    // times.  We need to try to identify if a function has been
-    // specialized already (and how many times) in order to start with
-    // the right counter. Otherwise, the bounded policy will become
+    // slash can run the specializer on the same module multiple
+    // times. We start the counters with the number of copies made by
+    // the previous runs. Otherwise, the bounded policy will become
     // aggressive.
+    SpecializationTable table(&M);
+    for (auto const& kv: table) {
+      const SpecializationTable::Specialization* spec = kv.second;
+      if (spec->parent == nullptr) continue;
+      while (spec->parent->parent != nullptr) {
+	spec = spec->parent;
+      }
+      m_num_copy_map[spec->parent->handle]++;
+    }
 
+    // Copies made before the table was recorded in the module can
+    // only be identified by their names.
     for (auto &F: M) {
       if (F.isDeclaration()) continue;
+      if (table.lookupSpecialization(&F)) continue;
       if (F.getName().startswith(OccamSpecStr)) {
-    	StringRef name = F.getName();
-    	// remove "__occam.spec."
-    	name = name.split(OccamSpecStr).second;
-    	// keep the string just before the first ( character
-    	name = name.split("(").first;
+    	std::string name;
+    	std::vector<std::string> args;
+    	if (!getSpecializationInfo(F, name, args)) continue;
     	// We might fail updating the counter if two functions have
     	// the same name.
     	if (const Function *specFunction = M.getFunction(name)) {
@@ -0,0 +1,365 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "CostBenefitSpecPolicy.h"
+#include "SpecializationTable.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallBitVector.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+#define CBP_LOG(...) __VA_ARGS__
+//#define CBP_LOG(...)
+
+namespace previrt {
+
+  struct CostBenefitSpecPolicy::Candidate {
+    const Function* callee;
+    // arguments of the copy (null if not specialized)
+    std::vector<Value*> args;
+    // instructions of the callee that fold
+    unsigned benefit;
+    // instructions of the callee
+    unsigned size;
+  };
+
+  static unsigned countInstructions(const Function& F) {
+    unsigned n = 0;
+    for (auto &BB: F) {
+      n += BB.size();
+    }
+    return n;
+  }
+
+  /* 
+   * Return the number of instructions of F that fold if the i-th
+   * argument is replaced with args[i] (if not null).
+   *
+   * This is a single pass in reverse post-order so it ignores phi
+   * nodes and loops.
+   */
+  static unsigned estimateFolded(const Function& F, const std::vector<Value*>& args,
+				 const DataLayout& DL) {
+    DenseMap<const Value*, Constant*> known;
+    unsigned i = 0;
+    for (auto &A: F.args()) {
+      if (i < args.size() && args[i]) {
+	known[&A] = cast<Constant>(args[i]);
+      }
+      ++i;
+    }
+
+    auto valueOf = [&known](Value* v) -> Constant* {
+      if (Constant* c = dyn_cast<Constant>(v)) {
+	return c;
+      }
+      auto it = known.find(v);
+      return (it != known.end() ? it->second : nullptr);
+    };
+
+    // A block is dead if it can only be reached through a dead edge.
+    DenseSet<const BasicBlock*> dead;
+    auto markDead = [&dead](const BasicBlock* BB) {
+      if (BB->getSinglePredecessor()) {
+	dead.insert(BB);
+      }
+    };
+
+    unsigned folded = 0;
+    ReversePostOrderTraversal<const Function*> RPOT(&F);
+    for (const BasicBlock* BB: RPOT) {
+      if (dead.count(BB)) {
+	folded += BB->size();
+	for (const BasicBlock* succ: successors(BB)) {
+	  markDead(succ);
+	}
+	continue;
+      }
+      
+      for (const Instruction& I: *BB) {
+	Instruction* inst = const_cast<Instruction*>(&I);
+	Constant* result = nullptr;
+	if (BranchInst* BI = dyn_cast<BranchInst>(inst)) {
+	  if (BI->isConditional()) {
+	    if (ConstantInt* c = dyn_cast_or_null<ConstantInt>(valueOf(BI->getCondition()))) {
+	      markDead(BI->getSuccessor(c->isZero() ? 0 : 1));
+	      folded++;
+	    }
+	  }
+	} else if (SwitchInst* SI = dyn_cast<SwitchInst>(inst)) {
+	  if (ConstantInt* c = dyn_cast_or_null<ConstantInt>(valueOf(SI->getCondition()))) {
+	    const BasicBlock* taken = SI->findCaseValue(c)->getCaseSuccessor();
+	    for (const BasicBlock* succ: successors(BB)) {
+	      if (succ != taken) {
+		markDead(succ);
+	      }
+	    }
+	    folded++;
+	  }
+	} else if (LoadInst* LI = dyn_cast<LoadInst>(inst)) {
+	  if (!LI->isVolatile()) {
+	    if (Constant* ptr = valueOf(LI->getPointerOperand())) {
+	      result = ConstantFoldLoadFromConstPtr(ptr, LI->getType(), DL);
+	    }
+	  }
+	} else if (CmpInst* CI = dyn_cast<CmpInst>(inst)) {
+	  Constant* lhs = valueOf(CI->getOperand(0));
+	  Constant* rhs = valueOf(CI->getOperand(1));
+	  if (lhs && rhs) {
+	    result = ConstantFoldCompareInstOperands(CI->getPredicate(), lhs, rhs, DL);
+	  }
+	} else if (isa<BinaryOperator>(inst) || isa<CastInst>(inst) ||
+		   isa<GetElementPtrInst>(inst) || isa<SelectInst>(inst) ||
+		   isa<ExtractValueInst>(inst)) {
+	  SmallVector<Constant*, 4> ops;
+	  for (Value* op: inst->operands()) {
+	    Constant* c = valueOf(op);
+	    if (!c) break;
+	    ops.push_back(c);
+	  }
+	  if (ops.size() == inst->getNumOperands()) {
+	    result = ConstantFoldInstOperands(inst, ops, DL);
+	  }
+	}
+	
+	if (result) {
+	  known[inst] = result;
+	  folded++;
+	}
+      }
+    }
+    return folded;
+  }
+  
+  CostBenefitSpecPolicy::CostBenefitSpecPolicy(Module &M, 
+					       std::unique_ptr<SpecializationPolicy> subpolicy,
+					       unsigned budget)
+    : m_subpolicy(std::move(subpolicy))
+    , m_module(M)
+    , m_budget(budget)
+    , m_intra_ranked(false)
+    , m_inter_ranked(false) {}
+
+  CostBenefitSpecPolicy::~CostBenefitSpecPolicy() {}
+
+  std::vector<unsigned>
+  CostBenefitSpecPolicy::admit(std::vector<Candidate>& candidates) const {
+    // -- The budget is relative to the module without the copies made
+    //    by previous runs. Those copies are already part of the growth.
+    SpecializationTable table(&m_module);
+    unsigned total = 0, used = 0;
+    for (auto &F: m_module) {
+      const SpecializationTable::Specialization* spec = table.lookupSpecialization(&F);
+      if (spec && spec->parent) {
+	used += countInstructions(F);
+      } else {
+	total += countInstructions(F);
+      }
+    }
+    const unsigned budget = (unsigned) (((uint64_t) total * m_budget) / 100);
+
+    // -- Greedy: best folded/size ratio first. Ties are broken by the
+    //    order of the candidates so the decisions are deterministic.
+    std::vector<unsigned> order;
+    for (unsigned i = 0; i < candidates.size(); ++i) {
+      if (candidates[i].benefit > 0) {
+	order.push_back(i);
+      }
+    }
+    std::stable_sort(order.begin(), order.end(), [&candidates](unsigned a, unsigned b) {
+	const Candidate& x = candidates[a];
+	const Candidate& y = candidates[b];
+	return (uint64_t) x.benefit * y.size > (uint64_t) y.benefit * x.size;
+      });
+
+    std::vector<unsigned> admitted;
+    for (unsigned i: order) {
+      const Candidate& c = candidates[i];
+      const unsigned growth = c.size - std::min(c.size, c.benefit);
+      if (used + growth > budget) {
+	CBP_LOG(errs() << "[CBP] " << c.callee->getName() << " folds "
+		<< c.benefit << "/" << c.size << " but exceeds the budget\n";);
+	continue;
+      }
+      used += growth;
+      CBP_LOG(errs() << "[CBP] " << c.callee->getName() << " folds "
+	      << c.benefit << "/" << c.size << " (growth " << used
+	      << "/" << budget << ")\n";);
+      admitted.push_back(i);
+    }
+    return admitted;
+  }
+  
+  void CostBenefitSpecPolicy::rankIntra() {
+    m_intra_ranked = true;
+
+    const DataLayout& DL = m_module.getDataLayout();
+    std::vector<Candidate> candidates;
+    std::map<IntraCall, unsigned> index;
+    for (auto &F: m_module) {
+      for (auto &B: F) {
+	for (auto &I: B) {
+	  Instruction* CI = dyn_cast<CallInst>(const_cast<Instruction*>(&I));
+	  if (!CI) CI = dyn_cast<InvokeInst>(const_cast<Instruction*>(&I));
+	  if (!CI) continue;
+	  CallSite CS(CI);
+	  const Function* calleeF = CS.getCalledFunction();
+	  // same restrictions as the intra-module specializer
+	  if (!calleeF || calleeF->isDeclaration() || calleeF->isVarArg() ||
+	      !calleeF->hasLocalLinkage() ||
+	      calleeF->hasFnAttribute(Attribute::OptimizeNone)) {
+	    continue;
+	  }
+	  std::vector<Value*> marks;
+	  if (!m_subpolicy->intraSpecializeOn(CS, marks)) {
+	    continue;
+	  }
+	  auto key = std::make_pair(calleeF, marks);
+	  auto it = index.find(key);
+	  if (it == index.end()) {
+	    Candidate c;
+	    c.callee = calleeF;
+	    c.args = marks;
+	    c.benefit = estimateFolded(*calleeF, marks, DL);
+	    c.size = countInstructions(*calleeF);
+	    it = index.insert(std::make_pair(key, candidates.size())).first;
+	    candidates.push_back(c);
+	  }
+	}
+      }
+    }
+
+    for (unsigned i: admit(candidates)) {
+      m_intra_admitted.insert(std::make_pair(candidates[i].callee, candidates[i].args));
+    }
+  }
+
+  static const Function* resolveFunction(const Module& M, StringRef name) {
+    if (const Function* f = M.getFunction(name)) {
+      return f;
+    }
+    if (const GlobalAlias* ga = M.getNamedAlias(name)) {
+      return dyn_cast<Function>(ga->getBaseObject());
+    }
+    return nullptr;
+  }
+  
+  void CostBenefitSpecPolicy::rankInter(const ComponentInterface& interface) {
+    m_inter_ranked = true;
+
+    const DataLayout& DL = m_module.getDataLayout();
+    std::vector<Candidate> candidates;
+    std::vector<InterCall> calls;
+    std::vector<SmallBitVector> callMarks;
+    for (auto ff = interface.begin(), fe = interface.end(); ff != fe; ++ff) {
+      const Function* calleeF = resolveFunction(m_module, ff->first());
+      if (!calleeF || calleeF->isDeclaration() || calleeF->isVarArg()) {
+	continue;
+      }
+      for (auto cc = interface.call_begin(ff->first()), ce = interface.call_end(ff->first());
+	   cc != ce; ++cc) {
+	const std::vector<PrevirtType>& args = (*cc)->args;
+	if (args.size() != calleeF->arg_size()) {
+	  continue;
+	}
+	SmallBitVector marks(args.size());
+	if (!m_subpolicy->interSpecializeOn(*calleeF, args, interface, marks)) {
+	  continue;
+	}
+	// Only scalars are concretized here: strings and globals
+	// would add new globals to the module.
+	Candidate c;
+	c.callee = calleeF;
+	for (unsigned i = 0; i < args.size(); ++i) {
+	  Type* ty = calleeF->getFunctionType()->getParamType(i);
+	  if (marks.test(i) && (ty->isIntegerTy() || ty->isFloatingPointTy())) {
+	    c.args.push_back(args[i].concretize(m_module, ty));
+	  } else {
+	    c.args.push_back(nullptr);
+	  }
+	}
+	c.benefit = estimateFolded(*calleeF, c.args, DL);
+	c.size = countInstructions(*calleeF);
+	candidates.push_back(c);
+	calls.push_back(std::make_pair(calleeF, &args));
+	callMarks.push_back(marks);
+      }
+    }
+
+    for (unsigned i: admit(candidates)) {
+      m_inter_admitted[calls[i]] = callMarks[i];
+    }
+  }
+  
+  bool CostBenefitSpecPolicy::intraSpecializeOn(CallSite CS,
+						std::vector<Value*>& marks) {
+    if (!m_intra_ranked) {
+      rankIntra();
+    }
+    const Function* calleeF = CS.getCalledFunction();
+    if (!calleeF) {
+      return false;
+    }
+    std::vector<Value*> args;
+    if (!m_subpolicy->intraSpecializeOn(CS, args) ||
+	!m_intra_admitted.count(std::make_pair(calleeF, args))) {
+      return false;
+    }
+    marks = args;
+    return true;
+  }
+  
+  bool CostBenefitSpecPolicy::interSpecializeOn(const Function& calleeF,
+						const std::vector<PrevirtType>& args,
+						const ComponentInterface& interface,
+						SmallBitVector& marks)  {
+    if (!m_inter_ranked) {
+      rankInter(interface);
+    }
+    auto it = m_inter_admitted.find(std::make_pair(&calleeF, &args));
+    if (it == m_inter_admitted.end()) {
+      return false;
+    }
+    marks = it->second;
+    return true;
+  }
+  
+} // end namespace
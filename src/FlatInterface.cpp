@@ -0,0 +1,720 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/*
+ * FlatInterface.cpp
+ *
+ * Reading and writing of the flat interface and rewrite files.
+ */
+
+#include "FlatInterface.h"
+#include "PrevirtualizeInterfaces.h"
+#include "PrevirtTypes.h"
+#include "proto/Previrt.pb.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<bool>
+FlatInterfaces("Pflat-interfaces",
+	       cl::init(false),
+	       cl::Hidden,
+	       cl::desc("Write the interface and rewrite files in the flat format"));
+
+namespace previrt
+{
+  using namespace flat;
+
+  static ulittle32_t
+  le32(uint32_t v)
+  {
+    ulittle32_t r;
+    r = v;
+    return r;
+  }
+
+  static ulittle64_t
+  le64(uint64_t v)
+  {
+    ulittle64_t r;
+    r = v;
+    return r;
+  }
+
+  // Whether the kind of type uses PrevirtType::str
+  static bool
+  hasString(uint32_t kind, uint32_t flags)
+  {
+    return kind == proto::S || kind == proto::F || kind == proto::G
+        || kind == proto::P || (kind == proto::I && flags > 64);
+  }
+
+  /* FlatInterface */
+
+  FlatInterface::FlatInterface(std::unique_ptr<MemoryBuffer> buffer)
+    : buffer(std::move(buffer)),
+      header(reinterpret_cast<const Header*>(this->buffer->getBufferStart()))
+  {
+  }
+
+  bool
+  FlatInterface::isFlat(StringRef data)
+  {
+    return data.size() >= sizeof(Header)
+        && data.startswith(StringRef(Magic, sizeof(Magic)));
+  }
+
+  std::unique_ptr<FlatInterface>
+  FlatInterface::open(std::unique_ptr<MemoryBuffer> buffer)
+  {
+    if (!isFlat(buffer->getBuffer())) {
+      return nullptr;
+    }
+    std::unique_ptr<FlatInterface> result(new FlatInterface(std::move(buffer)));
+    if (!result->validate()) {
+      return nullptr;
+    }
+    return result;
+  }
+
+  std::unique_ptr<FlatInterface>
+  FlatInterface::open(const std::string& filename)
+  {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+        MemoryBuffer::getFile(filename, -1, false);
+    if (!buffer) {
+      return nullptr;
+    }
+    return open(std::move(*buffer));
+  }
+
+  template<typename T>
+  ArrayRef<T>
+  FlatInterface::table(const Table& t) const
+  {
+    return ArrayRef<T>(reinterpret_cast<const T*>(buffer->getBufferStart() + t.offset),
+                       t.size);
+  }
+
+  // Check once that the tables are in the file and that the records
+  // only refer to records that exist, so the queries need no checks.
+  bool
+  FlatInterface::validate() const
+  {
+    const uint64_t size = buffer->getBufferSize();
+    auto inFile = [size](const Table& t, uint64_t recordSize) {
+      return uint64_t(t.offset) + uint64_t(t.size) * recordSize <= size;
+    };
+    const Header& h = *header;
+    if (!inFile(h.strings, 1) || !inFile(h.types, sizeof(Type))
+        || !inFile(h.elems, sizeof(ulittle32_t))
+        || !inFile(h.indices, sizeof(ulittle64_t))
+        || !inFile(h.functions, sizeof(Function))
+        || !inFile(h.calls, sizeof(Call))
+        || !inFile(h.args, sizeof(ulittle32_t))
+        || !inFile(h.references, sizeof(Str))
+        || !inFile(h.facts, sizeof(flat::Fact))
+        || !inFile(h.rewrites, sizeof(Rewrite))
+        || !inFile(h.perms, sizeof(ulittle32_t))
+        || h.num_definitions > h.facts.size) {
+      return false;
+    }
+
+    auto validStr = [&h](const Str& s) {
+      return uint64_t(s.offset) + s.size <= h.strings.size;
+    };
+    auto validRange = [](const Range& r, uint32_t n) {
+      return uint64_t(r.first) + r.size <= n;
+    };
+
+    ArrayRef<Type> types = table<Type>(h.types);
+    ArrayRef<ulittle32_t> elems = table<ulittle32_t>(h.elems);
+    for (unsigned i = 0, e = types.size(); i != e; ++i) {
+      const Type& t = types[i];
+      if (!proto::Type_IsValid(t.kind) || !validStr(t.str)
+          || !validRange(t.elems, h.elems.size)
+          || !validRange(t.indices, h.indices.size)) {
+        return false;
+      }
+      for (unsigned j = 0; j < t.elems.size; ++j) {
+        if (elems[t.elems.first + j] >= i)
+          return false;
+      }
+      switch (t.kind) {
+      case proto::V:
+        if (t.indices.size != 0)
+          return false;
+        break;
+      case proto::P:
+        // see PrevirtType::abstractPointer
+        if (t.elems.size != 1)
+          return false;
+        if (t.indices.size != 0
+            && (t.indices.size != 2 || types[elems[t.elems.first]].kind != proto::V))
+          return false;
+        break;
+      default:
+        if (t.elems.size != 0 || t.indices.size != 0)
+          return false;
+      }
+    }
+
+    ArrayRef<Function> fns = functions();
+    for (unsigned i = 0, e = fns.size(); i != e; ++i) {
+      if (!validStr(fns[i].name) || !validRange(fns[i].calls, h.calls.size))
+        return false;
+      if (i > 0 && !(str(fns[i - 1].name) < str(fns[i].name)))
+        return false;
+    }
+    for (const Call& c : table<Call>(h.calls)) {
+      if (!validRange(c.args, h.args.size)
+          || (c.rewrite != NoRewrite && c.rewrite >= h.rewrites.size))
+        return false;
+    }
+    for (ulittle32_t a : table<ulittle32_t>(h.args)) {
+      if (a >= types.size())
+        return false;
+    }
+    ArrayRef<Str> refs = table<Str>(h.references);
+    for (unsigned i = 0, e = refs.size(); i != e; ++i) {
+      if (!validStr(refs[i]))
+        return false;
+      if (i > 0 && !(str(refs[i - 1]) < str(refs[i])))
+        return false;
+    }
+    for (const flat::Fact& f : table<flat::Fact>(h.facts)) {
+      if (!validStr(f.name) || !validStr(f.lo) || !validStr(f.hi)
+          || f.value >= types.size())
+        return false;
+    }
+    for (const Rewrite& r : table<Rewrite>(h.rewrites)) {
+      if (!validStr(r.function) || !validRange(r.args, h.perms.size))
+        return false;
+    }
+    return true;
+  }
+
+  bool
+  FlatInterface::isTransform() const
+  {
+    return header->is_transform != 0;
+  }
+
+  StringRef
+  FlatInterface::str(const Str& s) const
+  {
+    return StringRef(buffer->getBufferStart() + header->strings.offset + s.offset,
+                     s.size);
+  }
+
+  ArrayRef<Function>
+  FlatInterface::functions() const
+  {
+    return table<Function>(header->functions);
+  }
+
+  const Function*
+  FlatInterface::findFunction(StringRef name) const
+  {
+    ArrayRef<Function> fns = functions();
+    const Function* f = std::lower_bound(fns.begin(), fns.end(), name,
+        [this](const Function& f, StringRef n) { return str(f.name) < n; });
+    if (f == fns.end() || str(f->name) != name) {
+      return nullptr;
+    }
+    return f;
+  }
+
+  ArrayRef<Call>
+  FlatInterface::calls(const Function& f) const
+  {
+    return table<Call>(header->calls).slice(f.calls.first, f.calls.size);
+  }
+
+  ArrayRef<ulittle32_t>
+  FlatInterface::args(const Call& c) const
+  {
+    return table<ulittle32_t>(header->args).slice(c.args.first, c.args.size);
+  }
+
+  bool
+  FlatInterface::isReferenced(StringRef name) const
+  {
+    ArrayRef<Str> refs = table<Str>(header->references);
+    const Str* r = std::lower_bound(refs.begin(), refs.end(), name,
+        [this](const Str& s, StringRef n) { return str(s) < n; });
+    return r != refs.end() && str(*r) == name;
+  }
+
+  PrevirtType
+  FlatInterface::type(uint32_t i) const
+  {
+    const Type& t = table<Type>(header->types)[i];
+    PrevirtType result;
+    result.kind = proto::Type(uint32_t(t.kind));
+    result.flags = t.flags;
+    result.word = t.word;
+    if (hasString(t.kind, t.flags)) {
+      result.str = PrevirtType::intern(str(t.str));
+    }
+    if (t.kind == proto::V || t.kind == proto::P) {
+      auto agg = std::make_shared<PrevirtType::Aggregate>();
+      for (ulittle32_t e : table<ulittle32_t>(header->elems).slice(t.elems.first,
+                                                                   t.elems.size)) {
+        agg->elems.push_back(type(e));
+      }
+      for (ulittle64_t idx : table<ulittle64_t>(header->indices).slice(t.indices.first,
+                                                                       t.indices.size)) {
+        agg->indices.push_back(idx);
+      }
+      result.agg = agg;
+    }
+    return result;
+  }
+
+  void
+  FlatInterface::load(ComponentInterface& ci) const
+  {
+    // the types are shared by many calls so they are only built once
+    std::vector<PrevirtType> types;
+    for (unsigned i = 0, e = header->types.size; i != e; ++i) {
+      types.push_back(type(i));
+    }
+
+    for (const Function& f : functions()) {
+      ArrayRef<Call> fcalls = calls(f);
+      if (fcalls.empty())
+        continue;
+      std::vector<CallInfo*>& infos = ci.calls[str(f.name)];
+      for (const Call& c : fcalls) {
+        CallInfo* info = CallInfo::Create(c.args.size, c.count);
+        for (ulittle32_t a : args(c)) {
+          info->args.push_back(types[a]);
+        }
+        infos.push_back(info);
+      }
+    }
+    for (const Str& r : table<Str>(header->references)) {
+      ci.references.insert(str(r).str());
+    }
+    ArrayRef<flat::Fact> facts = table<flat::Fact>(header->facts);
+    for (unsigned i = 0, e = facts.size(); i != e; ++i) {
+      const flat::Fact& f = facts[i];
+      previrt::Fact& fact = i < header->num_definitions ? ci.definitions[str(f.name).str()]
+                                                        : ci.globals[str(f.name).str()];
+      fact.value = types[f.value];
+      fact.nonnull = f.nonnull != 0;
+      fact.bits = f.bits;
+      fact.lo = str(f.lo).str();
+      fact.hi = str(f.hi).str();
+    }
+  }
+
+  void
+  FlatInterface::load(ComponentInterfaceTransform& rw) const
+  {
+    if (rw.interface == NULL) {
+      rw.ownsIface = true;
+      rw.interface = new ComponentInterface();
+    }
+    for (const Function& f : functions()) {
+      load(rw, f);
+    }
+  }
+
+  void
+  FlatInterface::load(ComponentInterfaceTransform& rw, const Function& f) const
+  {
+    if (rw.interface == NULL) {
+      rw.ownsIface = true;
+      rw.interface = new ComponentInterface();
+    }
+    ArrayRef<Rewrite> rewrites = table<Rewrite>(header->rewrites);
+    ArrayRef<ulittle32_t> perms = table<ulittle32_t>(header->perms);
+    FunctionHandle name = str(f.name).str();
+    for (const Call& c : calls(f)) {
+      if (c.rewrite == NoRewrite)
+        continue;
+      std::vector<PrevirtType> cargs;
+      for (ulittle32_t a : args(c)) {
+        cargs.push_back(type(a));
+      }
+      CallInfo* result = rw.interface->getOrCreateCall(name, cargs);
+      result->count += c.count;
+
+      const Rewrite& r = rewrites[c.rewrite];
+      std::vector<unsigned> to_args;
+      for (ulittle32_t p : perms.slice(r.args.first, r.args.size)) {
+        to_args.push_back(p);
+      }
+      rw.rewrite(name, result, str(r.function).str(), to_args);
+    }
+  }
+
+  /* Writing */
+
+  class FlatWriter {
+  private:
+    bool isTransform;
+    std::string strings;
+    StringMap<Str> stringIndex;
+    std::vector<Type> types;
+    std::vector<PrevirtType> typeValues;
+    std::unordered_multimap<size_t, uint32_t> typeIndex;
+    std::vector<ulittle32_t> elems;
+    std::vector<ulittle64_t> indices;
+    std::vector<Function> functions;
+    std::vector<Call> calls;
+    std::vector<ulittle32_t> args;
+    std::vector<Str> references;
+    std::vector<flat::Fact> facts;
+    uint32_t numDefinitions;
+    std::vector<Rewrite> rewrites;
+    std::vector<ulittle32_t> perms;
+
+    // operator== ignores some of the flags
+    static bool identical(const PrevirtType& a, const PrevirtType& b);
+    Str string(StringRef s);
+    uint32_t type(const PrevirtType& t);
+    uint32_t rewrite(const CallRewrite& r);
+    void fact(StringRef name, const previrt::Fact& f);
+
+  public:
+    FlatWriter(const ComponentInterface& ci, const ComponentInterfaceTransform* rw);
+    void write(raw_ostream& out) const;
+  };
+
+  bool
+  FlatWriter::identical(const PrevirtType& a, const PrevirtType& b)
+  {
+    if (a.kind != b.kind || a.flags != b.flags || a.word != b.word
+        || a.str.data() != b.str.data() || bool(a.agg) != bool(b.agg))
+      return false;
+    if (!a.agg || a.agg == b.agg)
+      return true;
+    if (a.agg->elems.size() != b.agg->elems.size()
+        || a.agg->indices != b.agg->indices)
+      return false;
+    for (unsigned i = 0, e = a.agg->elems.size(); i != e; ++i) {
+      if (!identical(a.agg->elems[i], b.agg->elems[i]))
+        return false;
+    }
+    return true;
+  }
+
+  Str
+  FlatWriter::string(StringRef s)
+  {
+    StringMap<Str>::iterator i = stringIndex.find(s);
+    if (i != stringIndex.end()) {
+      return i->second;
+    }
+    Str result;
+    result.offset = strings.size();
+    result.size = s.size();
+    strings.append(s.data(), s.size());
+    stringIndex[s] = result;
+    return result;
+  }
+
+  uint32_t
+  FlatWriter::type(const PrevirtType& t)
+  {
+    const size_t h = t.hash();
+    auto r = typeIndex.equal_range(h);
+    for (auto i = r.first; i != r.second; ++i) {
+      if (identical(typeValues[i->second], t))
+        return i->second;
+    }
+
+    // the elements come first
+    std::vector<uint32_t> children;
+    if (t.agg) {
+      for (const PrevirtType& elem : t.agg->elems) {
+        children.push_back(type(elem));
+      }
+    }
+
+    Type result;
+    std::memset(&result, 0, sizeof(result));
+    result.kind = t.kind;
+    result.flags = t.flags;
+    result.word = t.word;
+    if (hasString(t.kind, t.flags)) {
+      result.str = string(t.str);
+    }
+    result.elems.first = elems.size();
+    result.elems.size = children.size();
+    for (uint32_t c : children) {
+      elems.push_back(le32(c));
+    }
+    if (t.agg) {
+      result.indices.first = indices.size();
+      result.indices.size = t.agg->indices.size();
+      for (uint64_t idx : t.agg->indices) {
+        indices.push_back(le64(idx));
+      }
+    }
+
+    const uint32_t id = types.size();
+    types.push_back(result);
+    typeValues.push_back(t);
+    typeIndex.insert(std::make_pair(h, id));
+    return id;
+  }
+
+  uint32_t
+  FlatWriter::rewrite(const CallRewrite& r)
+  {
+    Rewrite result;
+    result.function = string(r.function);
+    result.args.first = perms.size();
+    result.args.size = r.args.size();
+    for (unsigned a : r.args) {
+      perms.push_back(le32(a));
+    }
+    rewrites.push_back(result);
+    return rewrites.size() - 1;
+  }
+
+  void
+  FlatWriter::fact(StringRef name, const previrt::Fact& f)
+  {
+    flat::Fact result;
+    result.name = string(name);
+    result.value = type(f.value);
+    result.nonnull = f.nonnull;
+    result.bits = f.bits;
+    result.lo = string(f.lo);
+    result.hi = string(f.hi);
+    facts.push_back(result);
+  }
+
+  FlatWriter::FlatWriter(const ComponentInterface& ci,
+                         const ComponentInterfaceTransform* rw)
+    : isTransform(rw != NULL), numDefinitions(0)
+  {
+    std::vector<StringRef> names;
+    for (ComponentInterface::FunctionIterator f = ci.begin(), e = ci.end();
+         f != e; ++f) {
+      names.push_back(f->first());
+    }
+    std::sort(names.begin(), names.end());
+
+    for (StringRef name : names) {
+      Function fn;
+      fn.name = string(name);
+      fn.calls.first = calls.size();
+      for (ComponentInterface::CallIterator c = ci.call_begin(name),
+             e = ci.call_end(name); c != e; ++c) {
+        uint32_t rwIdx = NoRewrite;
+        if (rw) {
+          // like the protobuf encoding, only the rewritten calls
+          const CallRewrite* r = rw->lookupRewrite(name.str(), *c);
+          if (r == NULL)
+            continue;
+          rwIdx = rewrite(*r);
+        }
+        Call call;
+        call.count = (*c)->count;
+        call.rewrite = rwIdx;
+        std::vector<uint32_t> cargs;
+        for (const PrevirtType& a : (*c)->args) {
+          cargs.push_back(type(a));
+        }
+        call.args.first = args.size();
+        call.args.size = cargs.size();
+        for (uint32_t a : cargs) {
+          args.push_back(le32(a));
+        }
+        calls.push_back(call);
+      }
+      fn.calls.size = calls.size() - fn.calls.first;
+      if (fn.calls.size > 0) {
+        functions.push_back(fn);
+      }
+    }
+
+    if (rw) {
+      return;
+    }
+    for (const std::string& r : ci.references) {
+      references.push_back(string(r));
+    }
+    for (std::map<std::string, previrt::Fact>::const_iterator
+           i = ci.definitions.begin(), e = ci.definitions.end(); i != e; ++i) {
+      fact(i->first, i->second);
+    }
+    numDefinitions = facts.size();
+    for (std::map<std::string, previrt::Fact>::const_iterator
+           i = ci.globals.begin(), e = ci.globals.end(); i != e; ++i) {
+      fact(i->first, i->second);
+    }
+  }
+
+  template<typename T>
+  static void
+  place(Table& t, const std::vector<T>& records, uint32_t& offset)
+  {
+    t.offset = offset;
+    t.size = records.size();
+    offset += records.size() * sizeof(T);
+  }
+
+  template<typename T>
+  static void
+  emit(raw_ostream& out, const std::vector<T>& records)
+  {
+    out.write(reinterpret_cast<const char*>(records.data()),
+              records.size() * sizeof(T));
+  }
+
+  void
+  FlatWriter::write(raw_ostream& out) const
+  {
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, Magic, sizeof(Magic));
+    h.is_transform = isTransform;
+    h.num_definitions = numDefinitions;
+
+    uint32_t offset = sizeof(Header);
+    h.strings.offset = offset;
+    h.strings.size = strings.size();
+    offset += strings.size();
+    place(h.types, types, offset);
+    place(h.elems, elems, offset);
+    place(h.indices, indices, offset);
+    place(h.functions, functions, offset);
+    place(h.calls, calls, offset);
+    place(h.args, args, offset);
+    place(h.references, references, offset);
+    place(h.facts, facts, offset);
+    place(h.rewrites, rewrites, offset);
+    place(h.perms, perms, offset);
+
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out << strings;
+    emit(out, types);
+    emit(out, elems);
+    emit(out, indices);
+    emit(out, functions);
+    emit(out, calls);
+    emit(out, args);
+    emit(out, references);
+    emit(out, facts);
+    emit(out, rewrites);
+    emit(out, perms);
+  }
+
+  void
+  writeFlat(const ComponentInterface& ci, raw_ostream& out)
+  {
+    FlatWriter(ci, NULL).write(out);
+  }
+
+  void
+  writeFlat(const ComponentInterfaceTransform& rw, raw_ostream& out)
+  {
+    FlatWriter(rw.getInterface(), &rw).write(out);
+  }
+
+  template<typename T>
+  static bool
+  writeFlatFile(const T& data, const std::string& filename)
+  {
+    std::error_code EC;
+    raw_fd_ostream out(filename, EC, sys::fs::F_None);
+    if (EC) {
+      return false;
+    }
+    writeFlat(data, out);
+    out.close();
+    bool success = !out.has_error();
+    out.clear_error();
+    return success;
+  }
+
+  template<typename T, typename Buf>
+  static bool
+  writeProtoFile(const T& data, const std::string& filename)
+  {
+    Buf buf;
+    codeInto<T, Buf>(data, buf);
+    std::ofstream output(filename.c_str(), std::ios::binary | std::ios::trunc);
+    return output.good() && buf.SerializeToOstream(&output);
+  }
+
+  bool
+  writeInterfaceFile(const ComponentInterface& ci, const std::string& filename,
+                     bool flat)
+  {
+    if (flat) {
+      return writeFlatFile(ci, filename);
+    }
+    return writeProtoFile<ComponentInterface, proto::ComponentInterface>(ci, filename);
+  }
+
+  bool
+  writeTransformFile(const ComponentInterfaceTransform& rw,
+                     const std::string& filename, bool flat)
+  {
+    if (flat) {
+      return writeFlatFile(rw, filename);
+    }
+    return writeProtoFile<ComponentInterfaceTransform,
+                          proto::ComponentInterfaceTransform>(rw, filename);
+  }
+
+  bool
+  writeInterfaceFile(const ComponentInterface& ci, const std::string& filename)
+  {
+    return writeInterfaceFile(ci, filename, FlatInterfaces);
+  }
+
+  bool
+  writeTransformFile(const ComponentInterfaceTransform& rw,
+                     const std::string& filename)
+  {
+    return writeTransformFile(rw, filename, FlatInterfaces);
+  }
+}
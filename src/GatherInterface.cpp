@@ -40,8 +40,11 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Support/KnownBits.h"
 
 #include "PrevirtualizeInterfaces.h"
+#include "FlatInterface.h"
 
 #include <vector>
 #include <set>
@@ -96,6 +99,57 @@ static Value *stripBitCast(Value *V) {
   }
 }
 
+/* Return what holds for all the values returned by F */
+static Fact getReturnFact(const Function& F, const DataLayout& DL) {
+  Fact fact;
+  std::vector<const Value*> rets;
+  for (const BasicBlock& bb: F) {
+    if (const ReturnInst* ret = dyn_cast<ReturnInst>(bb.getTerminator())) {
+      rets.push_back(ret->getReturnValue());
+    }
+  }
+  if (rets.empty()) {
+    return fact;
+  }
+
+  // always the same constant
+  bool same = true;
+  for (const Value* v: rets) {
+    same &= (v == rets[0]);
+  }
+  if (same) {
+    PrevirtType value = PrevirtType::abstract(rets[0]);
+    if (value.isConcrete()) {
+      fact.value = value;
+      return fact;
+    }
+  }
+
+  Type* retTy = F.getReturnType();
+  if (retTy->isIntegerTy()) {
+    const unsigned bits = retTy->getIntegerBitWidth();
+    APInt lo = APInt::getMaxValue(bits);
+    APInt hi = APInt::getMinValue(bits);
+    for (const Value* v: rets) {
+      KnownBits known(bits);
+      computeKnownBits(v, known, DL);
+      if (known.One.ult(lo)) lo = known.One;
+      if ((~known.Zero).ugt(hi)) hi = ~known.Zero;
+    }
+    if (!lo.isMinValue() || !hi.isMaxValue()) {
+      fact.bits = bits;
+      fact.lo = lo.toString(16, false);
+      fact.hi = hi.toString(16, false);
+    }
+  } else if (retTy->isPointerTy()) {
+    fact.nonnull = true;
+    for (const Value* v: rets) {
+      fact.nonnull &= isKnownNonZero(v, DL);
+    }
+  }
+  return fact;
+}
+
 class GatherInterfacePass : public ModulePass {
 public:
   ComponentInterface interface;
@@ -240,7 +294,10 @@ public:
     
     // global variables
     for (GlobalVariable &gv: M.globals()) {
-      if (gv.isDeclaration()) {
+      // available_externally globals (from -Pfacts, or from a
+      // specialization on a pointer to a constant global) are only
+      // copies of the initializer of another module.
+      if (gv.isDeclarationForLinker()) {
 	errs() << "Added reference to global " << gv.getName() << "\n";	
 	interface.reference(gv.getName());
       }
@@ -254,17 +311,40 @@ public:
       }
     }
     
+    // facts about the definitions that other modules can use
+    const DataLayout& DL = M.getDataLayout();
+    for (Function &F: M) {
+      if (F.isDeclarationForLinker() || F.hasLocalLinkage() || F.isInterposable()
+	  || F.getReturnType()->isVoidTy()) {
+	continue;
+      }
+      interface.define(F.getName(), getReturnFact(F, DL));
+    }
+    for (GlobalVariable &gv: M.globals()) {
+      if (gv.isDeclarationForLinker() || gv.hasLocalLinkage() || !gv.isConstant()
+	  || !gv.hasDefinitiveInitializer() || gv.isThreadLocal()) {
+	continue;
+      }
+      Fact fact;
+      fact.value = PrevirtType::abstract(gv.getInitializer());
+      if (fact.value.isConcrete()) {
+	interface.defineGlobal(gv.getName(), fact);
+      }
+    }
+    
+    // bound the interface when many call sites pass different constants
+    WidenStats widened;
+    if (interface.widen(widened)) {
+      errs() << "[GatherInterface] ";
+      widened.print(errs());
+    }
+
     if (GatherInterfaceOutput != "") {
-      proto::ComponentInterface ci;
-      codeInto<ComponentInterface, proto::ComponentInterface>(interface, ci);
-      std::ofstream output(GatherInterfaceOutput.c_str(), std::ios::binary);
-      assert(output.good());
-      bool success = ci.SerializeToOstream(&output);
+      bool success = writeInterfaceFile(interface, GatherInterfaceOutput);
       if (!success) {
 	errs() << "[GatherInterface] failed to write out interface\n";
 	assert(false && "failed to write out interface");
       }
-      output.close();
     }
     
     return false;
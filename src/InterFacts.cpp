@@ -0,0 +1,191 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/**
+ * Use the facts of the interfaces (values returned by the functions
+ * and initializers of the constant globals that other modules define)
+ * in the callsites and loads of the current module.
+ **/
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "PrevirtualizeInterfaces.h"
+#include "utils/PassResult.h"
+
+#include <vector>
+#include <string>
+
+using namespace llvm;
+
+static cl::list<std::string>
+FactsInput("Pfacts-input",
+	   cl::NotHidden,
+	   cl::desc("specifies the interfaces with the facts to use"));
+
+namespace previrt
+{
+
+  /* Use fact at the callsites of f. Return true if M changed. */
+  static bool applyReturnFact(Module& M, Function* f, const Fact& fact) {
+    std::vector<Instruction*> calls;
+    for (Use& U: f->uses()) {
+      CallSite cs(U.getUser());
+      if (cs && cs.isCallee(&U)) {
+	calls.push_back(cs.getInstruction());
+      }
+    }
+    if (calls.empty()) {
+      return false;
+    }
+
+    Type* retTy = f->getReturnType();
+    bool modified = false;
+    if (!fact.value.isUnknown()) {
+      // the call is kept for its side effects
+      Value* v = fact.value.concretize(M, retTy);
+      if (!v) {
+	return false;
+      }
+      for (Instruction* call: calls) {
+	if (!call->use_empty()) {
+	  call->replaceAllUsesWith(v);
+	  modified = true;
+	}
+      }
+      errs() << "\treplaced calls to " << f->getName() << " with "
+	     << fact.value.to_string() << "\n";
+    } else if (fact.bits != 0) {
+      if (!retTy->isIntegerTy(fact.bits)) {
+	return false;
+      }
+      // !range is half-open
+      APInt lo(fact.bits, fact.lo, 16);
+      APInt hi(fact.bits, fact.hi, 16);
+      MDNode* range = MDBuilder(M.getContext()).createRange(lo, hi + 1);
+      if (!range) {
+	return false;
+      }
+      for (Instruction* call: calls) {
+	if (!call->getMetadata(LLVMContext::MD_range)) {
+	  call->setMetadata(LLVMContext::MD_range, range);
+	  modified = true;
+	}
+      }
+    } else if (fact.nonnull && retTy->isPointerTy()) {
+      if (!f->hasAttribute(AttributeList::ReturnIndex, Attribute::NonNull)) {
+	f->addAttribute(AttributeList::ReturnIndex, Attribute::NonNull);
+	modified = true;
+      }
+    }
+    return modified;
+  }
+
+  /* Make the initializer of the constant global gv visible in M. */
+  static bool applyGlobalFact(Module& M, GlobalVariable* gv, const Fact& fact) {
+    Value* init = fact.value.concretize(M, gv->getValueType());
+    if (!init) {
+      return false;
+    }
+    gv->setInitializer(cast<Constant>(init));
+    gv->setConstant(true);
+    gv->setLinkage(GlobalValue::AvailableExternallyLinkage);
+    errs() << "\tinitialized " << gv->getName() << " with "
+	   << fact.value.to_string() << "\n";
+    return true;
+  }
+
+  bool ApplyFacts(Module& M, const ComponentInterface& I) {
+    bool modified = false;
+    for (auto &d: I.definitions) {
+      Function* f = M.getFunction(d.first);
+      if (!f || !f->isDeclaration() || f->isIntrinsic()) {
+	continue;
+      }
+      modified |= applyReturnFact(M, f, d.second);
+    }
+    for (auto &g: I.globals) {
+      GlobalVariable* gv = M.getGlobalVariable(g.first);
+      if (!gv || !gv->isDeclaration() || gv->isThreadLocal()) {
+	continue;
+      }
+      modified |= applyGlobalFact(M, gv, g.second);
+    }
+    return modified;
+  }
+
+  class InterFactsPass : public ModulePass {
+  public:
+
+    ComponentInterface interface;
+    static char ID;
+
+  public:
+
+    InterFactsPass()
+      : ModulePass(ID) {
+      for (cl::list<std::string>::const_iterator b = FactsInput.begin(),
+	     e = FactsInput.end(); b != e; ++b) {
+        errs() << "Reading file '" << *b << "'...";
+        if (interface.readFromFile(*b)) {
+          errs() << "success\n";
+        } else {
+          errs() << "failed\n";
+        }
+      }
+    }
+
+    virtual ~InterFactsPass() {}
+
+    virtual bool runOnModule(Module& M) {
+      errs() << "InterFactsPass::runOnModule: " << M.getModuleIdentifier() << "\n";
+      utils::PassResult result("Pfacts", M);
+      bool modified = ApplyFacts(M, interface);
+      result.report(M, modified);
+      return modified;
+    }
+  };
+
+  char InterFactsPass::ID;
+}
+
+static RegisterPass<previrt::InterFactsPass>
+X("Pfacts",
+  "Use the return values and constant globals of other modules",
+  false, false);
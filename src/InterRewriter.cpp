@@ -41,8 +41,11 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include "PrevirtualizeInterfaces.h"
+#include "FlatInterface.h"
 #include "Specializer.h"
+#include "utils/PassResult.h"
 
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -83,6 +86,7 @@ namespace previrt
   // Specialize M's callsites if the callee is external according to T
   bool TransformComponent(Module& M, ComponentInterfaceTransform& T) { 
     bool modified = false;
+    RewriteTable table(T);
     for (ComponentInterfaceTransform::FMap::const_iterator i = T.rewrites.begin(), e = T.rewrites.end();
 	 i != e; ++i) {
 
@@ -103,7 +107,7 @@ namespace previrt
 	  // If we are not the callee we should bail
 	  if(!cs.isCallee(use)){ continue; }
 	  
-	  const CallRewrite* const rw = T.lookupRewrite(i->first, cs.arg_begin(), cs.arg_end());
+	  const RewriteTable::Entry* const rw = table.lookup(i->first, cs.arg_begin(), cs.arg_end());
 	  if (!rw){ continue; }
 	  
           #if 0
@@ -112,7 +116,7 @@ namespace previrt
 		 << "' in function '" << (owner == NULL ? "??" : owner->getParent()->getName())
 		 << "' on arguments [";
 	  for (unsigned int i = 0, cnt = 0; i < cs.arg_size(); ++i) {
-	    if (std::find(rw->args.begin(), rw->args.end(), i) == rw->args.end()) {
+	    if (!rw->kept.test(i)) {
 	      if (cnt++ != 0)
 		errs() << ",";
 	      if (Function* funptr = dyn_cast<Function> (cs.getArgument(i)))
@@ -126,7 +130,7 @@ namespace previrt
 	  
 	  if (cs.getCalledFunction () && cs.getCalledFunction ()->hasExternalLinkage()) {
 	    for (unsigned int i = 0; i < cs.arg_size(); ++i) {
-	      if (std::find(rw->args.begin(), rw->args.end(), i) == rw->args.end()) {
+	      if (!rw->kept.test(i)) {
 		if (Function* funptr = dyn_cast<Function> (cs.getArgument(i))) {
 		  // XXX: we are specializing a callsite that has an
 		  // argument with the address of a function
@@ -142,7 +146,7 @@ namespace previrt
 	    }
 	  }
 
-	  Instruction* newInst = applyRewriteToCall(M, rw, cs);
+	  Instruction* newInst = applyRewriteToCall(M, rw->rewrite, cs);
 	  llvm::ReplaceInstWithInst(cs.getInstruction(), newInst);
 	  modified = true;
 	}
@@ -155,6 +159,9 @@ namespace previrt
   public:
     
     ComponentInterfaceTransform transform;
+    // Flat rewrite files are queried in place: only the calls to the
+    // functions of the module are loaded into transform.
+    std::vector<std::unique_ptr<FlatInterface>> flats;
     static char ID;
     
   public:
@@ -167,7 +174,10 @@ namespace previrt
       for (cl::list<std::string>::const_iterator b = RewriteComponentInput.begin(),
 	     e = RewriteComponentInput.end(); b != e; ++b) {
         errs() << "Reading file '" << *b << "'...";
-        if (transform.readTransformFromFile(*b)) {
+        if (std::unique_ptr<FlatInterface> flat = FlatInterface::open(*b)) {
+          flats.push_back(std::move(flat));
+          errs() << "success (mapped)\n";
+        } else if (transform.readTransformFromFile(*b)) {
           errs() << "success\n";
         } else {
           errs() << "failed\n";
@@ -178,18 +188,36 @@ namespace previrt
     }
     
     virtual ~InterRewriterPass() {}
+
+    // Load the rewrites of the functions of M from the flat files
+    void loadFlat(Module& M) {
+      for (const std::unique_ptr<FlatInterface>& flat : flats) {
+        for (Function& F : M) {
+          if (const flat::Function* f = flat->findFunction(F.getName())) {
+            flat->load(transform, *f);
+          }
+        }
+      }
+      flats.clear();
+    }
     
     virtual bool runOnModule(Module& M) {
+      if (!flats.empty()) {
+        loadFlat(M);
+        errs() << "Loaded " << transform.rewriteCount() << " rewrites\n";
+      }
       if (!transform.interface) {
         return false;
       }
       errs() << "InterRewriterPass:runOnModule: " << M.getModuleIdentifier() << "\n";
+      utils::PassResult result("Prewrite", M);
       bool modified = TransformComponent(M, this->transform);
       if (modified) {
         errs() << "...progress...\n";
       } else {
         errs() << "...no progress...\n";
       }
+      result.report(M, modified);
       return modified;
     }
     
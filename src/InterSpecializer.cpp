@@ -48,13 +48,17 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include "PrevirtualizeInterfaces.h"
+#include "FlatInterface.h"
 #include "Specializer.h"
+#include "SpecializationTable.h"
 #include "SpecializationPolicy.h"
 /* here specialization policies */
 #include "AggressiveSpecPolicy.h"
 #include "RecursiveGuardSpecPolicy.h"
 #include "BoundedSpecPolicy.h"
 #include "OnlyOnceSpecPolicy.h"
+#include "CostBenefitSpecPolicy.h"
+#include "ProfileSpecPolicy.h"
 
 #include <vector>
 #include <string>
@@ -76,7 +80,14 @@ SpecPolicy("Pspecialize-policy",
 	clEnumValN(previrt::SpecializationPolicyType::BOUNDED, "bounded",
 		   "Always specialize if number of copies so far <= Ppeval-max-spec-copies"),
 	clEnumValN(previrt::SpecializationPolicyType::NONREC, "nonrec-aggressive",
-		   "Specialize always if some constant arg and function is non-recursive")),
+		   "Specialize always if some constant arg and function is non-recursive"),
+	clEnumValN(previrt::SpecializationPolicyType::COST_BENEFIT, "cost-benefit",
+		   "Specialize if enough of the callee folds, under a growth budget"),
+	clEnumValN(previrt::SpecializationPolicyType::PROFILE, "profile",
+		   "Specialize always if some constant arg and function is hot in a value profile"),
+	clEnumValN(previrt::SpecializationPolicyType::RECURSIVE, "recursive",
+		   "Specialize recursive functions on the args invariant across the recursion "
+		   "and unfold the recursion up to Pspecialize-max-recursion-depth")),
         cl::init(previrt::SpecializationPolicyType::NONREC));
 
 static cl::opt<unsigned>
@@ -84,6 +95,26 @@ MaxSpecCopies("Pspecialize-max-bounded",
 	   cl::init(5),
 	   cl::desc("Maximum number of copies for a function if -Pspecialize-policy=bounded"));
 
+static cl::opt<unsigned>
+MaxRecursionDepth("Pspecialize-max-recursion-depth",
+		  cl::init(2),
+		  cl::desc("Maximum number of copies of a recursive function on varying args if -Pspecialize-policy=recursive"));
+
+static cl::opt<unsigned>
+GrowthBudget("Pspecialize-growth-budget",
+	     cl::init(20),
+	     cl::desc("Maximum growth of the module, in percent of its size, if -Pspecialize-policy=cost-benefit"));
+
+static cl::opt<std::string>
+ValueProfile("Pspecialize-profile",
+	     cl::init(""),
+	     cl::desc("Value profile used if -Pspecialize-policy=profile"));
+
+static cl::opt<unsigned>
+ProfileMinCount("Pspecialize-profile-min-count",
+		cl::init(1000),
+		cl::desc("Minimum number of calls to a function to specialize it"));
+
 static cl::list<std::string>
 SpecCompIn("Pspecialize-input",
 	   cl::NotHidden,
@@ -126,6 +157,7 @@ namespace previrt
 
     int rewrite_count = 0;
     const ComponentInterface& I = T.getInterface();
+    SpecializationTable table(&M);
     // TODO: What needs to be done?
     // - Should try to handle strings & arrays
     // Iterate through all functions in the interface of T
@@ -169,17 +201,24 @@ namespace previrt
         args.reserve(arg_count);
         argPerm.reserve(marks.count());
         for (unsigned i = 0; i < arg_count; i++) {
+	  Value *concreteArg = nullptr;
           if (marks.test(i)) {
 	      Type * paramType = func->getFunctionType()->getParamType(i);
-	      Value *concreteArg = call->args[i].concretize(M, paramType);
-	      args.push_back(concreteArg);
-	      assert(concreteArg->getType() == paramType
+	      // nullptr if the aggregate does not fit paramType
+	      concreteArg = call->args[i].concretize(M, paramType);
+	      assert((!concreteArg || concreteArg->getType() == paramType)
 		     && "Specializing function with concrete argument of wrong type!");
-          } else {
+          }
+	  if (concreteArg) {
+	      args.push_back(concreteArg);
+	  } else {
             args.push_back(nullptr);
             argPerm.push_back(i);
           }
         }
+	if (argPerm.size() == arg_count) {
+	  continue;
+	}
 	
 	/*
 	  args is a list of pointers to values
@@ -192,9 +231,17 @@ namespace previrt
 	  args[i] = nullptr iff i is in argsPerm for i < arg_count.
 	*/
 
-        Function* specialized_func = specializeFunction(func, args);
-	if (!specialized_func) {
-	  continue;
+        Function* specialized_func = nullptr;
+        if (const SpecializationTable::Specialization* version =
+	    table.findSpecialization(func, args)) {
+	  // made by a previous run on this module
+	  specialized_func = version->handle;
+	} else {
+	  specialized_func = specializeFunction(func, args);
+	  if (!specialized_func) {
+	    continue;
+	  }
+	  table.addSpecialization(func, args, specialized_func);
 	}
         specialized_func->setLinkage(GlobalValue::ExternalLinkage);
         FunctionHandle rewriteTo = specialized_func->getName();
@@ -287,6 +334,27 @@ namespace previrt {
 	policy.reset(new RecursiveGuardSpecPolicy(std::move(subpolicy), cg));
       break;
       }
+      case SpecializationPolicyType::RECURSIVE: {
+	std::unique_ptr<SpecializationPolicy> subpolicy =
+	  llvm::make_unique<AggressiveSpecPolicy>();
+	CallGraph& cg = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+	policy.reset(new RecursiveGuardSpecPolicy(std::move(subpolicy), cg,
+						  true, MaxRecursionDepth));
+	break;
+      }
+      case SpecializationPolicyType::COST_BENEFIT: {
+	std::unique_ptr<SpecializationPolicy> subpolicy =
+	  llvm::make_unique<AggressiveSpecPolicy>();
+	policy.reset(new CostBenefitSpecPolicy(M, std::move(subpolicy), GrowthBudget));
+	break;
+      }
+      case SpecializationPolicyType::PROFILE: {
+	std::unique_ptr<SpecializationPolicy> subpolicy =
+	  llvm::make_unique<AggressiveSpecPolicy>();
+	policy.reset(new ProfileSpecPolicy(std::move(subpolicy), ValueProfile,
+					   ProfileMinCount, 100));
+	break;
+      }
       default:;;
       }
       
@@ -317,15 +385,10 @@ namespace previrt {
 
       /* writing the output ("rw" rewrite file) to the -Pspecialize-output argument */
       if (SpecCompOut != "") {
-        proto::ComponentInterfaceTransform buf;
-        codeInto(this->transform, buf);
-        std::ofstream output(SpecCompOut.c_str(),
-			     std::ios::binary | std::ios::trunc);
-	bool success = buf.SerializeToOstream(&output);
+	bool success = writeTransformFile(this->transform, SpecCompOut);
 	if (!success) {
 	  assert (false && "failed to write out interface");
 	}
-        output.close();
       }
       
       return modified;
@@ -42,7 +42,9 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include "PrevirtualizeInterfaces.h"
+#include "FlatInterface.h"
 
+#include <memory>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -149,13 +151,41 @@ static bool setInternalLinkage(GlobalValue &GV) {
   }
 }
 
+typedef std::vector<std::unique_ptr<FlatInterface>> FlatInterfaces;
+
 /*
  * Remove all code from the given module that is not necessary to
- * implement the given interface.
+ * implement the given interface. The interface is I together with
+ * the flat interfaces, which are queried in place.
  */
-bool MinimizeComponent(Module& M, const ComponentInterface& I) {
+bool MinimizeComponent(Module& M, const ComponentInterface& I,
+		       const FlatInterfaces& flats) {
   
   errs() << "InternalizePass::runOnModule: " << M.getModuleIdentifier() << "\n";
+
+  auto isCalled = [&I, &flats](StringRef name) {
+    if (I.calls.find(name) != I.calls.end()) {
+      return true;
+    }
+    for (const std::unique_ptr<FlatInterface>& flat : flats) {
+      const flat::Function* f = flat->findFunction(name);
+      if (f && !flat->calls(*f).empty()) {
+	return true;
+      }
+    }
+    return false;
+  };
+  auto isReferenced = [&I, &flats](StringRef name) {
+    if (I.references.find(name) != I.references.end()) {
+      return true;
+    }
+    for (const std::unique_ptr<FlatInterface>& flat : flats) {
+      if (flat->isReferenced(name)) {
+	return true;
+      }
+    }
+    return false;
+  };
   
   bool modified = false;
   // for stats
@@ -190,7 +220,7 @@ bool MinimizeComponent(Module& M, const ComponentInterface& I) {
       continue;
     }
     
-    if (I.references.find(alias.getName()) == I.references.end() && alias.use_empty()) {
+    if (!isReferenced(alias.getName()) && alias.use_empty()) {
       errs() << "Remove unused alias " << alias.getName() << "\n";
       unusedAliases.push_back(&alias);
     } else {
@@ -218,8 +248,8 @@ bool MinimizeComponent(Module& M, const ComponentInterface& I) {
 	// f is discardable if unused in other compilation units
 	isDiscardableIfUnusedExternally(f.getLinkage()) && 
 	// unused in other compilation units
-	I.calls.find(f.getName()) == I.calls.end() &&
-	I.references.find(f.getName()) == I.references.end() &&
+	!isCalled(f.getName()) &&
+	!isReferenced(f.getName()) &&
 	// The address of f has not been taken
 	!f.hasAddressTaken() &&	
 	// there is no an alias to f that we want to keep
@@ -257,7 +287,7 @@ bool MinimizeComponent(Module& M, const ComponentInterface& I) {
     
     if (gv.hasInitializer() &&
 	// global is unused
-	I.references.find(gv.getName()) == I.references.end() && 
+	!isReferenced(gv.getName()) && 
 	isDiscardableIfUnusedExternally(gv.getLinkage()) &&
 	// there is no an alias to f that we want to keep
 	!keepAliasees.count(&gv)) {
@@ -321,6 +351,8 @@ bool MinimizeComponent(Module& M, const ComponentInterface& I) {
 class InternalizePass : public ModulePass {
 public:
   ComponentInterface interface;
+  // flat interfaces are queried in place instead of being loaded
+  FlatInterfaces flats;
   static char ID;
   
 public:
@@ -329,7 +361,10 @@ public:
     errs() << "InternalizePass()\n";
     for (std::string input: InterfaceInput) {
       errs() << "Reading file '" << input << "'...";
-      if (interface.readFromFile(input)) {
+      if (std::unique_ptr<FlatInterface> flat = FlatInterface::open(input)) {
+	flats.push_back(std::move(flat));
+	errs() << "success (mapped)\n";
+      } else if (interface.readFromFile(input)) {
 	errs() << "success\n";
       } else {
 	errs() << "failed\n";
@@ -341,7 +376,7 @@ public:
   virtual ~InternalizePass() {}
   
   virtual bool runOnModule(Module& M) {
-    return MinimizeComponent(M, interface);
+    return MinimizeComponent(M, interface, flats);
   }
 };
 
@@ -36,6 +36,7 @@
  **/
 
 #include "llvm/Pass.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
@@ -47,15 +48,20 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include "SpecializationTable.h"
 #include "Specializer.h"
+#include "utils/PassResult.h"
 /* here specialization policies */
 #include "AggressiveSpecPolicy.h"
 #include "RecursiveGuardSpecPolicy.h"
 #include "BoundedSpecPolicy.h"
 #include "OnlyOnceSpecPolicy.h"
+#include "CostBenefitSpecPolicy.h"
+#include "ProfileSpecPolicy.h"
 
 using namespace llvm;
 using namespace previrt;
@@ -73,7 +79,14 @@ SpecPolicy("Ppeval-policy",
 	clEnumValN(SpecializationPolicyType::BOUNDED, "bounded",
 		   "Always specialize if number of copies so far <= Ppeval-max-spec-copies"),
 	clEnumValN(SpecializationPolicyType::NONREC, "nonrec-aggressive",
-		   "Specialize always if some constant arg and function is non-recursive")),
+		   "Specialize always if some constant arg and function is non-recursive"),
+	clEnumValN(SpecializationPolicyType::COST_BENEFIT, "cost-benefit",
+		   "Specialize if enough of the callee folds, under a growth budget"),
+	clEnumValN(SpecializationPolicyType::PROFILE, "profile",
+		   "Specialize on constant args and on the dominant values of a value profile"),
+	clEnumValN(SpecializationPolicyType::RECURSIVE, "recursive",
+		   "Specialize recursive functions on the args invariant across the recursion "
+		   "and unfold the recursion up to Ppeval-max-recursion-depth")),
 	cl::init(SpecializationPolicyType::NONREC));
 
 static cl::opt<unsigned>
@@ -81,10 +94,35 @@ MaxSpecCopies("Ppeval-max-bounded",
 	      cl::init(5),
 	      cl::desc("Maximum number of copies for a function if -Ppeval-policy=bounded"));
 
+static cl::opt<unsigned>
+MaxRecursionDepth("Ppeval-max-recursion-depth",
+		  cl::init(2),
+		  cl::desc("Maximum number of copies of a recursive function on varying args if -Ppeval-policy=recursive"));
+
+static cl::opt<unsigned>
+GrowthBudget("Ppeval-growth-budget",
+	     cl::init(20),
+	     cl::desc("Maximum growth of the module, in percent of its size, if -Ppeval-policy=cost-benefit"));
+
+static cl::opt<std::string>
+ValueProfile("Ppeval-profile",
+	     cl::init(""),
+	     cl::desc("Value profile used if -Ppeval-policy=profile"));
+
+static cl::opt<unsigned>
+ProfileMinCount("Ppeval-profile-min-count",
+		cl::init(1000),
+		cl::desc("Minimum number of calls to specialize on a profiled value"));
+
+static cl::opt<unsigned>
+ProfileMinPercent("Ppeval-profile-min-percent",
+		  cl::init(90),
+		  cl::desc("Minimum percentage of the calls with the profiled value"));
+
 static cl::opt<bool>
 OptSpecialized("Ppeval-opt",
 	       cl::init(false),
-	       cl::desc("Optimize new specialized functions"));
+	       cl::desc("Optimize new specialized functions and their callers"));
 
 
 namespace previrt {
@@ -169,17 +207,13 @@ static bool trySpecializeFunction(Function* f, SpecializationTable& table,
     errs() << "]\n";
     #endif
         
-    // --- build a specialized function if specScheme is more
-    //     refined than all existing specialized versions.
+    // --- build a specialized function unless there is already a
+    //     version that refines specScheme and is refined by it,
+    //     i.e., a version with exactly the same scheme.
     Function* specialized_callee = nullptr;
-    std::vector<const SpecializationTable::Specialization*> versions;
-    table.getSpecializations(callee, specScheme, versions);
-    for (std::vector<const SpecializationTable::Specialization*>::iterator i =
-	   versions.begin(), e = versions.end(); i != e; ++i) {
-      if (SpecializationTable::Specialization::refines(specScheme, (*i)->args)) {
-	specialized_callee = (*i)->handle;
-	break;
-      }
+    if (const SpecializationTable::Specialization* version =
+	table.findSpecialization(callee, specScheme)) {
+      specialized_callee = version->handle;
     }
     
     if (!specialized_callee) {
@@ -202,7 +236,20 @@ static bool trySpecializeFunction(Function* f, SpecializationTable& table,
     }
     assert(specialized_arg_count == argPerm.size());
     Instruction* newInst = specializeCallSite(ci, specialized_callee, argPerm);
-    llvm::ReplaceInstWithInst(ci, newInst);
+    // -- the policy can choose values that are not constant at the
+    //    callsite (e.g., from a profile). Those must be checked at
+    //    runtime.
+    std::vector<std::pair<unsigned, Constant*>> guards;
+    for (unsigned i = 0; i < callee->arg_size(); i++) {
+      if (specScheme[i] && specScheme[i] != cs.getArgument(i)) {
+	guards.push_back(std::make_pair(i, cast<Constant>(specScheme[i])));
+      }
+    }
+    if (guards.empty()) {
+      llvm::ReplaceInstWithInst(ci, newInst);
+    } else {
+      guardCallSite(ci, newInst, guards);
+    }
     modified = true;
   }
   
@@ -228,6 +275,8 @@ public:
   
 bool SpecializerPass::runOnModule(Module &M) {
 
+  utils::PassResult result("Ppeval", M);
+
   // -- Create the specialization policy. Bail out if no policy.
   std::unique_ptr<SpecializationPolicy> policy;
   switch (SpecPolicy) {
@@ -252,6 +301,27 @@ bool SpecializerPass::runOnModule(Module &M) {
       policy.reset(new RecursiveGuardSpecPolicy(std::move(subpolicy), cg));
       break;
     }
+    case SpecializationPolicyType::RECURSIVE: {
+      std::unique_ptr<SpecializationPolicy> subpolicy =
+	llvm::make_unique<AggressiveSpecPolicy>();
+      CallGraph& cg = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+      policy.reset(new RecursiveGuardSpecPolicy(std::move(subpolicy), cg,
+						true, MaxRecursionDepth));
+      break;
+    }
+    case SpecializationPolicyType::COST_BENEFIT: {
+      std::unique_ptr<SpecializationPolicy> subpolicy =
+	llvm::make_unique<AggressiveSpecPolicy>();
+      policy.reset(new CostBenefitSpecPolicy(M, std::move(subpolicy), GrowthBudget));
+      break;
+    }
+    case SpecializationPolicyType::PROFILE: {
+      std::unique_ptr<SpecializationPolicy> subpolicy =
+	llvm::make_unique<AggressiveSpecPolicy>();
+      policy.reset(new ProfileSpecPolicy(std::move(subpolicy), ValueProfile,
+					 ProfileMinCount, ProfileMinPercent));
+      break;
+    }
     default:;;
   }
 
@@ -262,42 +332,58 @@ bool SpecializerPass::runOnModule(Module &M) {
 
   // -- Specialize functions defined in M
   std::vector<Function*> to_add;
+  std::vector<Function*> callers;
   SpecializationTable table(&M);  
   bool modified = false;
   for (auto &f: M) {
     if(f.isDeclaration()) continue;
-    modified |= trySpecializeFunction(&f, table, *policy, to_add);
+    if (trySpecializeFunction(&f, table, *policy, to_add)) {
+      callers.push_back(&f);
+      modified = true;
+    }
   }
   
-  // -- Optimize new function and add it into the module
-  std::unique_ptr<llvm::legacy::FunctionPassManager> optimizer;
-  if (optimize) {
-    optimizer.reset(new llvm::legacy::FunctionPassManager(&M));
-    //PassManagerBuilder builder;
-    //builder.OptLevel = 3;
-    //builder.populateFunctionPassManager(*optimizer);
-  }
-
-  while (!to_add.empty()) {
-    Function* f = to_add.back();
-    to_add.pop_back();
+  // -- Add the new functions into the module
+  for (Function* f: to_add) {
     if (f->getParent() == &M  || f->isDeclaration()) {
       // The function was already in the module or
       // has already been added in this round of
       // specialization, no need to add it twice
       continue;
     }
-    if (optimizer) {
-      optimizer->run(*f);
-    }
     M.getFunctionList().push_back(f);
   }
 
+  // -- Propagate the new constants in the new functions and in the
+  //    callsites that call them. This is much cheaper than running
+  //    -O3 on the whole module after each round.
+  if (optimize && modified) {
+    llvm::legacy::FunctionPassManager optimizer(&M);
+    optimizer.add(createSCCPPass());
+    optimizer.add(createInstructionCombiningPass());
+    optimizer.add(createCFGSimplificationPass());
+    optimizer.add(createEarlyCSEPass());
+    optimizer.add(createGVNPass());
+    optimizer.add(createDeadCodeEliminationPass());
+    optimizer.add(createCFGSimplificationPass());
+    optimizer.doInitialization();
+    SmallPtrSet<Function*, 32> done;
+    for (auto fs: {&to_add, &callers}) {
+      for (Function* f: *fs) {
+	if (!f->isDeclaration() && done.insert(f).second) {
+	  optimizer.run(*f);
+	}
+      }
+    }
+    optimizer.doFinalization();
+  }
+
   if (modified) {
     errs() << "...progress...\n";
   } else {
     errs() << "...no progress...\n";
   }
+  result.report(M, modified);
   
   return modified;
 }
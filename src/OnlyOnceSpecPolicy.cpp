@@ -33,6 +33,7 @@
 
 #include "OnlyOnceSpecPolicy.h"
 #include "AggressiveSpecPolicy.h"
+#include "SpecializationTable.h"
 #include "llvm/ADT/SmallBitVector.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
@@ -48,6 +49,13 @@ namespace previrt {
   static StringRef OccamSpecStr = "__occam_spec.";
   
   OnlyOnceSpecPolicy::OnlyOnceSpecPolicy(Module &M) {
+    SpecializationTable table(&M);
+    for (auto const& kv: table) {
+      if (kv.second->parent != nullptr) {
+	m_specialized.insert(kv.first);
+      }
+    }
+    
     // Precompute some information used by intra specialization
     DenseSet<const Function*> calledS;
     for (auto &F: M) {
@@ -70,13 +78,19 @@ namespace previrt {
     }
   }
 
+  bool OnlyOnceSpecPolicy::isSpecialized(const Function& F) const {
+    // The name is only needed for copies made before the table was
+    // recorded in the module.
+    return m_specialized.count(&F) > 0 || F.getName().startswith(OccamSpecStr);
+  }
+
   bool OnlyOnceSpecPolicy::intraSpecializeOn(CallSite CS, std::vector<Value*>& marks) {    
     const Function *calleeF = CS.getCalledFunction();
     if (!calleeF) {
       return false;
     }
     // don't touch a function if has been already specialized
-    if (calleeF->getName().startswith(OccamSpecStr)) {
+    if (isSpecialized(*calleeF)) {
       return false;
     }
     auto it = m_blacklist.find(calleeF);
@@ -93,7 +107,7 @@ namespace previrt {
 					     SmallBitVector& marks) {
 
     // don't touch a function if has been already specialized
-    if (calleeF.getName().startswith(OccamSpecStr)) {
+    if (isSpecialized(calleeF)) {
       return false;
     }
     
@@ -0,0 +1,192 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/**
+ * Fused intra-module pipeline.
+ *
+ * Runs in a single process the sequence of intra-module passes that
+ * razor would otherwise run as separate opt invocations:
+ *
+ *   1. -O3
+ *   2. -Pdevirt followed by forced inlining of bounce functions
+ *   3. -Ppeval followed by forced inlining of specialized functions
+ *      until -Ppeval does not make progress, and -O3 once at the end.
+ *
+ * The options of -Pdevirt and -Ppeval (e.g., -Ppeval-policy) are
+ * read by those passes as usual.
+ **/
+
+#include "llvm/Pass.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/PassInfo.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+
+#include "utils/Inliner.h"
+
+using namespace llvm;
+
+static cl::opt<bool>
+PipelineDevirt("Ppeval-pipeline-devirt",
+	       cl::init(false),
+	       cl::desc("Resolve indirect calls with -Pdevirt before specialization"));
+
+static cl::opt<bool>
+PipelineInlineBounce("Ppeval-pipeline-inline-bounce",
+	       cl::init(false),
+	       cl::desc("Inline bounce functions generated by devirtualization"));
+
+static cl::opt<bool>
+PipelineInlineSpec("Ppeval-pipeline-inline-spec",
+	       cl::init(false),
+	       cl::desc("Inline specialized functions after each round"));
+
+static cl::opt<bool>
+PipelineDisableInlining("Ppeval-pipeline-disable-inlining",
+	       cl::init(false),
+	       cl::desc("Do not run the inliner as part of -O3"));
+
+static const StringRef bounce_prefix = "__occam.bounce";
+static const StringRef spec_prefix = "__occam_spec.";
+
+namespace previrt {
+
+// Same pipeline as "opt -O3 -disable-simplify-libcalls
+// --disable-loop-vectorization --disable-slp-vectorization"
+static void optimizeModule(Module &M) {
+  PassManagerBuilder builder;
+  builder.OptLevel = 3;
+  builder.SizeLevel = 0;
+  if (!PipelineDisableInlining) {
+    builder.Inliner = createFunctionInliningPass(3, 0, false);
+  }
+  builder.LoopVectorize = false;
+  builder.SLPVectorize = false;
+
+  TargetLibraryInfoImpl TLII(Triple(M.getTargetTriple()));
+  TLII.disableAllFunctions();
+  builder.LibraryInfo = new TargetLibraryInfoImpl(TLII);
+
+  legacy::FunctionPassManager fpm(&M);
+  legacy::PassManager mpm;
+  mpm.add(new TargetLibraryInfoWrapperPass(TLII));
+  builder.populateFunctionPassManager(fpm);
+  builder.populateModulePassManager(mpm);
+
+  fpm.doInitialization();
+  for (Function &F: M) {
+    fpm.run(F);
+  }
+  fpm.doFinalization();
+  mpm.run(M);
+}
+
+// Run the registered pass name on M. Return true if M changed.
+static bool runPass(Module &M, StringRef name) {
+  const PassInfo* PI = PassRegistry::getPassRegistry()->getPassInfo(name);
+  if (!PI || !PI->getNormalCtor()) {
+    errs() << "Ppeval-pipeline: cannot create pass " << name << "\n";
+    return false;
+  }
+  legacy::PassManager mgr;
+  mgr.add(PI->getNormalCtor()());
+  return mgr.run(M);
+}
+
+static bool inlinePrefixed(Module &M, StringRef prefix) {
+  SmallPtrSet<Function*, 8> ToInline;
+  for (auto &F: M) {
+    if (!F.isDeclaration() && F.getName().startswith(prefix)) {
+      ToInline.insert(&F);
+    }
+  }
+  if (ToInline.empty()) {
+    return false;
+  }
+  return utils::inlineOnly(M, ToInline);
+}
+
+class PevalPipelinePass : public llvm::ModulePass {
+public:
+  static char ID;
+
+  PevalPipelinePass(): ModulePass(ID) {}
+
+  virtual StringRef getPassName() const override {
+    return "Intra-module specialization pipeline";
+  }
+
+  virtual bool runOnModule(Module &M) override {
+    optimizeModule(M);
+    errs() << "\tintra module optimization finished succesfully\n";
+
+    if (PipelineDevirt) {
+      runPass(M, "Pdevirt");
+      errs() << "\tresolved indirect calls finished succesfully\n";
+      if (PipelineInlineBounce) {
+	inlinePrefixed(M, bounce_prefix);
+      }
+    }
+
+    // -Ppeval-opt cleans up the new functions and their callers so
+    // -O3 is only needed once at the end.
+    bool specialized = false;
+    while (runPass(M, "Ppeval")) {
+      errs() << "\tintra-module specialization finished\n";
+      specialized = true;
+      if (PipelineInlineSpec) {
+	inlinePrefixed(M, spec_prefix);
+      }
+    }
+    if (specialized) {
+      optimizeModule(M);
+    }
+    // The module is always rewritten by -O3.
+    return true;
+  }
+};
+
+char PevalPipelinePass::ID = 0;
+
+} // end namespace previrt
+
+static RegisterPass<previrt::PevalPipelinePass>
+X("Ppeval-pipeline", "Fused intra-module specialization pipeline", false, false);
@@ -48,6 +48,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Analysis/ValueTracking.h"
 
 #include "llvm/IR/IRBuilder.h"
@@ -57,27 +58,50 @@
 #include "proto/Previrt.pb.h"
 #include "Specializer.h"
 
+#include <algorithm>
+#include <mutex>
+
 using namespace llvm;
 
 namespace previrt
 {
   PrevirtType::EqCache PrevirtType::cacheEq;
 
-  PrevirtType::PrevirtType()
+  template<>
+    void
+    codeInto<PrevirtType, proto::PrevirtType>(const PrevirtType&,
+        proto::PrevirtType&);
+
+  // Types compare their strings by address
+  StringRef
+  PrevirtType::intern(StringRef s)
   {
-    buffer.set_type(proto::U);
+    static StringSet<> pool;
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+    return pool.insert(s).first->getKey();
   }
 
-  PrevirtType::PrevirtType(const proto::PrevirtType& pt)
+  static const fltSemantics*
+  semanticsOf(unsigned sem)
   {
-    buffer.CopyFrom(pt);
+    switch (sem) {
+#define CASE(x) case proto::x: return &APFloat::x();
+    CASE(IEEEdouble)
+    CASE(IEEEhalf)
+    CASE(IEEEsingle)
+    CASE(IEEEquad)
+    CASE(x87DoubleExtended)
+    CASE(PPCDoubleDouble)
+    CASE(Bogus)
+#undef CASE
+    }
+    return NULL;
   }
 
-  PrevirtType&
-  PrevirtType::operator=(const PrevirtType& from)
+  PrevirtType::PrevirtType()
+    : kind(proto::U), flags(0), word(0)
   {
-    this->buffer.CopyFrom(from.buffer);
-    return *this;
   }
 
   bool
@@ -89,45 +113,127 @@ namespace previrt
   bool
   PrevirtType::operator==(const PrevirtType& other) const
   {
-    if (buffer.type() != other.buffer.type())
+    if (kind != other.kind)
       return false;
-    switch (buffer.type()) {
+    switch (kind) {
     default:
       assert(false && "missing case in PrevirtType::operator==");
     case proto::U:
     case proto::N:
       return true;
     case proto::S:
-      return buffer.str().data() == other.buffer.str().data();
+    case proto::G:
+      return str.data() == other.str.data();
     case proto::I:
+      return flags == other.flags && word == other.word
+          && str.data() == other.str.data();
     case proto::F:
-      return buffer.int_().bits() == other.buffer.int_().bits()
-          && buffer.int_().value() == other.buffer.int_().value();
-    case proto::G:
-      return buffer.global().name() == other.buffer.global().name();
+      return flags == other.flags && str.data() == other.str.data();
+    case proto::V:
+      return agg == other.agg || agg->elems == other.agg->elems;
+    case proto::P:
+      return str.data() == other.str.data() && flags == other.flags
+          && (agg == other.agg || (agg->elems == other.agg->elems
+                                   && agg->indices == other.agg->indices));
     }
     return false;
   }
 
+  hash_code
+  PrevirtType::hash() const
+  {
+    switch (kind) {
+    case proto::S:
+    case proto::G:
+      return hash_combine(kind, str);
+    case proto::I:
+      return hash_combine(kind, flags, word, str);
+    case proto::F:
+      return hash_combine(kind, flags, str);
+    case proto::V:
+    case proto::P: {
+      hash_code h = hash_combine(kind, str, flags);
+      for (const PrevirtType& elem : agg->elems) {
+        h = hash_combine(h, elem.hash());
+      }
+      return hash_combine(h, hash_combine_range(agg->indices.begin(),
+                                                agg->indices.end()));
+    }
+    default:
+      return hash_combine(kind);
+    }
+  }
+
+  size_t
+  PrevirtType::byteSize() const
+  {
+    size_t size = 4 + str.size() + (kind == proto::I ? 8 : 0);
+    if (agg) {
+      for (const PrevirtType& elem : agg->elems) {
+        size += elem.byteSize();
+      }
+      size += 8 * agg->indices.size();
+    }
+    return size;
+  }
+
   static bool
   StringFromValue(const Value* val, StringRef &out)
   {
     return getConstantStringInfo(val, out, 0, false);
   }
 
+  // Bigger aggregates are not copied into the interfaces.
+  static const unsigned MaxAggregateBytes = 4096;
+  // Bound on the chains of pointers between constant globals.
+  static const unsigned MaxPointerDepth = 4;
+
   PrevirtType
   PrevirtType::unknown()
   {
-    PrevirtType t;
-    t.buffer.set_type(proto::U);
-    return t;
+    return PrevirtType();
   }
 
   PrevirtType
   PrevirtType::abstract(const llvm::Value* const val)
+  {
+    return abstract(val, MaxPointerDepth);
+  }
+
+  bool
+  PrevirtType::abstractPointer(const GlobalVariable* gv,
+                               ArrayRef<uint64_t> indices, unsigned depth,
+                               PrevirtType& out)
+  {
+    if (depth == 0 || !gv->hasName() || !gv->isConstant()
+        || !gv->hasDefinitiveInitializer() || gv->isThreadLocal())
+      return false;
+    // A local global is copied into the other module so its address
+    // must not be significant.
+    if (gv->hasLocalLinkage() && !gv->hasGlobalUnnamedAddr())
+      return false;
+    PrevirtType init = abstract(gv->getInitializer(), depth - 1);
+    if (!init.isConcrete())
+      return false;
+    // The array length is needed to rebuild the type of gv
+    if (!indices.empty() && init.kind != proto::V)
+      return false;
+
+    auto ptr = std::make_shared<Aggregate>();
+    ptr->elems.push_back(init);
+    ptr->indices.assign(indices.begin(), indices.end());
+    out = PrevirtType();
+    out.kind = proto::P;
+    out.str = intern(gv->getName());
+    out.flags = gv->hasLocalLinkage();
+    out.agg = ptr;
+    return true;
+  }
+
+  PrevirtType
+  PrevirtType::abstract(const llvm::Value* const val, unsigned depth)
   {
     PrevirtType result;
-    result.buffer.set_type(proto::U);
     const Constant* cnst = dyn_cast<const Constant>(val);
     if (cnst == NULL) {
 #if DUMP
@@ -200,37 +306,40 @@ namespace previrt
     errs() << "\n";
 #endif
     if (const ConstantInt* ci = dyn_cast<const ConstantInt> (val)) {
-      result.buffer.set_type(proto::I);
-      result.buffer.mutable_int_()->set_bits(ci->getBitWidth());
-      result.buffer.mutable_int_()->set_value(
-          ci->getValue().toString(16, true));
+      result.kind = proto::I;
+      result.flags = ci->getBitWidth();
+      if (ci->getBitWidth() <= 64) {
+        result.word = ci->getZExtValue();
+      } else {
+        result.str = intern(ci->getValue().toString(16, true));
+      }
       return result;
     } else if (cnst->isNullValue()) {
-      result.buffer.set_type(proto::N);
+      result.kind = proto::N;
       return result;
     } else if (const ConstantFP* cf = dyn_cast<const ConstantFP>(val)) {
       char dst[128];
       const APFloat& val = cf->getValueAPF();
       val.convertToHexString(dst, 0, false, APFloat::rmNearestTiesToEven);
       if (&val.getSemantics() == &APFloat::Bogus()) {
-        result.buffer.mutable_float_()->set_sem(proto::Bogus);
+        result.flags = proto::Bogus;
       } else if (&val.getSemantics() == &APFloat::IEEEhalf()) {
-        result.buffer.mutable_float_()->set_sem(proto::IEEEhalf);
+        result.flags = proto::IEEEhalf;
       } else if (&val.getSemantics() == &APFloat::IEEEdouble()) {
-        result.buffer.mutable_float_()->set_sem(proto::IEEEdouble);
+        result.flags = proto::IEEEdouble;
       } else if (&val.getSemantics() == &APFloat::IEEEquad()) {
-        result.buffer.mutable_float_()->set_sem(proto::IEEEquad);
+        result.flags = proto::IEEEquad;
       } else if (&val.getSemantics() == &APFloat::IEEEsingle()) {
-        result.buffer.mutable_float_()->set_sem(proto::IEEEsingle);
+        result.flags = proto::IEEEsingle;
       } else if (&val.getSemantics() == &APFloat::PPCDoubleDouble()) {
-        result.buffer.mutable_float_()->set_sem(proto::PPCDoubleDouble);
+        result.flags = proto::PPCDoubleDouble;
       } else if (&val.getSemantics() == &APFloat::x87DoubleExtended()) {
-        result.buffer.mutable_float_()->set_sem(proto::x87DoubleExtended);
+        result.flags = proto::x87DoubleExtended;
       } else {
         return result;
       }
-      result.buffer.mutable_float_()->set_data(dst);
-      result.buffer.set_type(proto::F);
+      result.str = intern(dst);
+      result.kind = proto::F;
       return result;
     } else if (const GlobalValue* gv = dyn_cast<const GlobalValue>(cnst)) {
       // gv can be alias, function or variable
@@ -238,32 +347,73 @@ namespace previrt
 
       // function
       if (isa<Function>(gv) && gv->getName() != "") {
-	result.buffer.set_type(proto::G);
-	result.buffer.mutable_global()->set_name(gv->getName().data());
+	result.kind = proto::G;
+	result.str = intern(gv->getName());
 	return result;
       }
 
+      // pointer to a constant global that can be copied
+      if (const GlobalVariable* gvar = dyn_cast<GlobalVariable>(gv)) {
+        if (abstractPointer(gvar, None, depth, result)) {
+          return result;
+        }
+      }
+
       // global alias or variable
       if (gv->getName() != "") {
         if (gv->isExternalLinkage(gv->getLinkage())) {
-          result.buffer.set_type(proto::G);
-          result.buffer.mutable_global()->set_name(gv->getName().data());
+          result.kind = proto::G;
+          result.str = intern(gv->getName());
           if (const GlobalVariable* gvar = dyn_cast<GlobalVariable>(gv)) {
-            result.buffer.mutable_global()->set_is_const(gvar->isConstant());
+            result.flags = G_VARIABLE | (gvar->isConstant() ? G_CONST : 0);
           }
           return result;
         } else {
 	  return result;
         }
       }
-    } else if (isa<const ConstantExpr>(cnst)) {
+    } else if (const ConstantExpr* ce = dyn_cast<const ConstantExpr>(cnst)) {
 	StringRef out;
 	// See if it's a string constant
 	if (StringFromValue(val, out)) {
-	  result.buffer.set_type(proto::S);
-	  result.buffer.mutable_str()->set_data(out);
+	  result.kind = proto::S;
+	  result.str = intern(out);
+	  result.flags = true;
 	  return result;
 	}
+	// See if it's a pointer to an element of a constant global array
+	if (ce->getOpcode() == Instruction::GetElementPtr
+	    && ce->getNumOperands() == 3) {
+	  const GlobalVariable* gvar = dyn_cast<GlobalVariable>(ce->getOperand(0));
+	  const ConstantInt* i0 = dyn_cast<ConstantInt>(ce->getOperand(1));
+	  const ConstantInt* i1 = dyn_cast<ConstantInt>(ce->getOperand(2));
+	  if (gvar && gvar->getValueType()->isArrayTy()
+	      && i0 && i0->isZero() && i1 && !i1->isNegative()) {
+	    uint64_t indices[2] = {0, i1->getZExtValue()};
+	    if (abstractPointer(gvar, indices, depth, result)) {
+	      return result;
+	    }
+	  }
+	}
+    } else if (isa<ConstantAggregate>(cnst) || isa<ConstantDataSequential>(cnst)) {
+      unsigned n = cnst->getNumOperands();
+      if (const ConstantDataSequential* cds = dyn_cast<ConstantDataSequential>(cnst)) {
+        n = cds->getNumElements();
+      }
+      auto vec = std::make_shared<Aggregate>();
+      vec->elems.reserve(n);
+      size_t size = 0;
+      for (unsigned i = 0; i < n; ++i) {
+        PrevirtType elem = abstract(cnst->getAggregateElement(i), depth);
+        size += elem.byteSize();
+        if (!elem.isConcrete() || size > MaxAggregateBytes) {
+          return result;
+        }
+        vec->elems.push_back(elem);
+      }
+      result.kind = proto::V;
+      result.agg = vec;
+      return result;
     }
     return result;
   }
@@ -275,12 +425,12 @@ namespace previrt
     const Constant* cnst = dyn_cast<const Constant>(val);
     // TODO: Why did I start needing this?
     if (cnst == NULL) {
-      if (this->buffer.type() == proto::U)
+      if (this->kind == proto::U)
         return LOOSE_MATCH;
       else
         return NO_MATCH;
     }
-    switch (buffer.type()) {
+    switch (kind) {
     default:
       assert(false);
       break;
@@ -295,7 +445,7 @@ namespace previrt
     case proto::S: {
       StringRef out;
       if (StringFromValue(val, out)) {
-        if (out == buffer.str().data())
+        if (out == str)
           return EXACT_MATCH;
         else
           return NO_MATCH;
@@ -304,26 +454,18 @@ namespace previrt
     }
     case proto::I:
       if (const ConstantInt* va = dyn_cast<const ConstantInt>(val)) {
-        if (buffer.int_().bits() == va->getBitWidth()
-            && buffer.int_().value() == va->getValue().toString(16, true))
+        if (flags == va->getBitWidth()
+            && (flags <= 64 ? word == va->getZExtValue()
+                            : str == va->getValue().toString(16, true)))
           return EXACT_MATCH;
       }
       return NO_MATCH;
     case proto::F:
       if (const ConstantFP* va = dyn_cast<const ConstantFP>(val)) {
-        const fltSemantics* sem = NULL;
-        switch (buffer.float_().sem()) {
-#define CASE(x) case proto::x: { if (&va->getValueAPF().getSemantics() != &APFloat::x()) return NO_MATCH; sem = &APFloat::x(); break; }
-        CASE(IEEEdouble)
-        CASE(IEEEhalf)
-        CASE(IEEEsingle)
-        CASE(IEEEquad)
-        CASE(x87DoubleExtended)
-        CASE(PPCDoubleDouble)
-        CASE(Bogus)
-#undef CASE
-        }
-        APFloat apf(*sem, buffer.float_().data());
+        const fltSemantics* sem = semanticsOf(flags);
+        if (sem != &va->getValueAPF().getSemantics())
+          return NO_MATCH;
+        APFloat apf(*sem, str);
         if (apf.bitwiseIsEqual(va->getValueAPF())) {
           return EXACT_MATCH;
         }
@@ -331,49 +473,91 @@ namespace previrt
       return NO_MATCH;
     case proto::G:
       if (const GlobalValue* gv = dyn_cast<const GlobalValue>(val->stripPointerCasts())) {
-        if (gv->getName() == buffer.global().name()) {
+        if (gv->getName() == str) {
           return EXACT_MATCH;
         }
       }
       return NO_MATCH;
+    case proto::V:
+    case proto::P:
+      if (abstract(val) == *this) {
+        return EXACT_MATCH;
+      }
+      return NO_MATCH;
     }
 
     return NO_MATCH;
   }
 
+  void
+  PrevirtType::refining(const llvm::Value* const val,
+                        std::vector<PrevirtType>& out)
+  {
+    auto add = [&out](const PrevirtType& t) {
+      if (std::find(out.begin(), out.end(), t) == out.end())
+        out.push_back(t);
+    };
+    // must follow the cases of refines
+    add(unknown());
+    add(abstract(val));
+    const Constant* cnst = dyn_cast<const Constant>(val);
+    if (cnst == NULL)
+      return;
+    if (cnst->isNullValue()) {
+      PrevirtType t;
+      t.kind = proto::N;
+      add(t);
+    }
+    if (const GlobalValue* gv = dyn_cast<const GlobalValue>(val->stripPointerCasts())) {
+      PrevirtType t;
+      t.kind = proto::G;
+      t.str = intern(gv->getName());
+      add(t);
+    }
+    StringRef str;
+    if (StringFromValue(val, str)) {
+      PrevirtType t;
+      t.kind = proto::S;
+      t.str = intern(str);
+      t.flags = true;
+      add(t);
+    }
+  }
+
   llvm::Value*
   PrevirtType::concretize(Module& M, Type* type) const
   {
       llvm::Value *concreteValue = NULL;
-      switch (buffer.type()) {
+      switch (this->kind) {
       default:
 	  break;
       case proto::N:
 	  concreteValue = Constant::getNullValue(type);
 	  break;
       case proto::I:
-	  assert(buffer.int_().IsInitialized());
+	  if (!type->isIntegerTy(flags))
+	      break;
 	  concreteValue =
 	      ConstantInt::get(M.getContext(),
-			       APInt(buffer.int_().bits(), buffer.int_().value(), 16));
+			       flags <= 64 ? APInt(flags, word) : APInt(flags, str, 16));
 	  break;
       case proto::F:
+	  if (!type->isFloatingPointTy())
+	      break;
 	  concreteValue =
-	      ConstantFP::get(type, StringRef(buffer.float_().data()));
+	      ConstantFP::get(type, str);
 	  break;
       case proto::S:
-	  assert(buffer.str().IsInitialized());
-	  if (!buffer.str().cstr())
+	  if (!flags)
 	      break;
 	  { // Scope sc locally
 	      GlobalVariable* sc =
-		  materializeStringLiteral(M, buffer.str().data().c_str());
+		  materializeStringLiteral(M, str.str().c_str());
 	      concreteValue = charStarFromStringConstant(M, sc);
 	  }
 	  break;
       case proto::G:
-	  assert(buffer.global().IsInitialized());
-	  concreteValue = M.getGlobalVariable(buffer.global().name(), false);
+	  concreteValue = M.getGlobalVariable(str, false);
 	  if (concreteValue == NULL) {
 	      // GlobalValues are always pointers and the resulting type
 	      // will be a pointer to the type in the constructor, so we
@@ -386,20 +570,126 @@ namespace previrt
 		     && "Unexpected concretization of G to non-pointer type");
 	      Type * elemType = type->getContainedType(0);
 	      if (elemType->isFunctionTy()) {
-		  concreteValue = M.getFunction(buffer.global().name());
+		  concreteValue = M.getFunction(str);
 		  if (concreteValue == NULL) {
 		      concreteValue = Function::Create(cast<FunctionType>(elemType),
-						       GlobalVariable::ExternalLinkage, buffer.global().name(), &M);
+						       GlobalVariable::ExternalLinkage, str, &M);
 		  }
 	      } else {
-		  concreteValue = new GlobalVariable(M, elemType, buffer.global().is_const(),
-						     GlobalVariable::ExternalLinkage, NULL, buffer.global().name());
+		  concreteValue = new GlobalVariable(M, elemType, flags & G_CONST,
+						     GlobalVariable::ExternalLinkage, NULL, str);
 	      }
 	  }
 	  break;
+      case proto::V: {
+	  // The shape of the aggregate comes from type
+	  const unsigned n = agg->elems.size();
+	  if (type->isStructTy()) {
+	      if (type->getStructNumElements() != n)
+		  break;
+	  } else if (type->isArrayTy()) {
+	      if (type->getArrayNumElements() != n)
+		  break;
+	  } else if (type->isVectorTy()) {
+	      if (type->getVectorNumElements() != n)
+		  break;
+	  } else {
+	      break;
+	  }
+	  std::vector<Constant*> elems;
+	  elems.reserve(n);
+	  for (unsigned i = 0; i < n; ++i) {
+	      Type* elemType = type->isStructTy() ? type->getStructElementType(i)
+		                                  : type->getSequentialElementType();
+	      Value* elem = agg->elems[i].concretize(M, elemType);
+	      if (!elem)
+		  break;
+	      elems.push_back(cast<Constant>(elem));
+	  }
+	  if (elems.size() != n)
+	      break;
+	  if (StructType* st = dyn_cast<StructType>(type)) {
+	      concreteValue = ConstantStruct::get(st, elems);
+	  } else if (ArrayType* at = dyn_cast<ArrayType>(type)) {
+	      concreteValue = ConstantArray::get(at, elems);
+	  } else {
+	      concreteValue = ConstantVector::get(elems);
+	  }
+	  break;
+      }
+      case proto::P: {
+	  const PrevirtType& ptrInit = agg->elems[0];
+	  const std::vector<uint64_t>& indices = agg->indices;
+	  PointerType* ptrType = dyn_cast<PointerType>(type);
+	  if (!ptrType || ptrType->getAddressSpace() != 0)
+	      break;
+	  // rebuild the type of the global from the type of the pointer
+	  Type* globalType = ptrType->getElementType();
+	  if (indices.size() == 2) {
+	      const unsigned n = ptrInit.agg->elems.size();
+	      if (indices[1] >= n)
+		  break;
+	      globalType = ArrayType::get(globalType, n);
+	  } else if (!indices.empty()) {
+	      break;
+	  }
+	  Value* init = ptrInit.concretize(M, globalType);
+	  if (!init)
+	      break;
+
+	  GlobalVariable* gv = nullptr;
+	  if (flags) {
+	      // The address of the original global is not significant
+	      // so a private copy will do. Constants are uniqued so a
+	      // copy made before for the same initializer is one of
+	      // its users.
+	      for (User* U: init->users()) {
+		  GlobalVariable* copy = dyn_cast<GlobalVariable>(U);
+		  if (copy && copy->getParent() == &M &&
+		      copy->getName().startswith("__occam.const.") &&
+		      copy->isConstant() && copy->hasPrivateLinkage() &&
+		      copy->getValueType() == globalType &&
+		      copy->getInitializer() == init) {
+		      gv = copy;
+		      break;
+		  }
+	      }
+	      if (!gv) {
+		  gv = new GlobalVariable(M, globalType, true, GlobalValue::PrivateLinkage,
+					  cast<Constant>(init), "__occam.const." + str);
+		  gv->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+	      }
+	  } else {
+	      // Keep the original global but make its initializer
+	      // visible here.
+	      gv = M.getGlobalVariable(str, true);
+	      if (!gv) {
+		  gv = new GlobalVariable(M, globalType, true,
+					  GlobalValue::AvailableExternallyLinkage,
+					  cast<Constant>(init), str);
+	      } else if (gv->hasLocalLinkage() || gv->getValueType() != globalType) {
+		  break;
+	      } else if (gv->isDeclaration()) {
+		  gv->setInitializer(cast<Constant>(init));
+		  gv->setConstant(true);
+		  gv->setLinkage(GlobalValue::AvailableExternallyLinkage);
+	      }
+	  }
+	  if (indices.size() == 2) {
+	      Type* i64 = Type::getInt64Ty(M.getContext());
+	      Constant* gep[2] = { ConstantInt::get(i64, indices[0]),
+				   ConstantInt::get(i64, indices[1]) };
+	      concreteValue = ConstantExpr::getInBoundsGetElementPtr(globalType, gv, gep);
+	  } else {
+	      concreteValue = gv;
+	  }
+	  break;
+      }
+      }
+      if (concreteValue && type != concreteValue->getType()) {
+	  // e.g., the interface and the callee disagree on a field
+	  return nullptr;
       }
-      assert(type == concreteValue->getType()
-	     && "Concretization did not procude value of expected type!");
       return concreteValue;
   }
 
@@ -408,41 +698,49 @@ namespace previrt
   {
     // TODO: check which of these work
 
-    return buffer.type() == proto::I || // Integer
-      buffer.type() == proto::G || // Global
-      buffer.type() == proto::N || // Null
-      buffer.type() == proto::S || // String
-      buffer.type() == proto::F;  // float
+    return kind == proto::I || // Integer
+      kind == proto::G || // Global
+      kind == proto::N || // Null
+      kind == proto::S || // String
+      kind == proto::F || // float
+      kind == proto::V || // constant aggregate
+      kind == proto::P;   // pointer into a constant global
   }
 
   bool
   PrevirtType::isUnknown() const
   {
-    return buffer.type() == proto::U;
+    return kind == proto::U;
   }
 
   std::string
   PrevirtType::to_string() const
   {
-    switch (buffer.type()) {
+    switch (kind) {
     default:
       return "?";
     case proto::N:
       return "null";
     case proto::I:
-      assert(buffer.int_().IsInitialized());
-      return std::string("0x") + buffer.int_().value();
+      if (flags <= 64)
+        return std::string("0x") + APInt(flags, word).toString(16, true);
+      return std::string("0x") + str.str();
     case proto::F:
-      return buffer.float_().data();
+      return str.str();
     case proto::S: {
-      assert(buffer.str().IsInitialized());
-      if (!buffer.str().cstr())
+      if (!flags)
         return NULL;
-      return std::string("S:") + utohexstr(HashString(buffer.str().data()));
+      return std::string("S:") + utohexstr(HashString(str));
     }
     case proto::G:
-      assert(buffer.global().IsInitialized());
-      return buffer.global().name();
+      return str.str();
+    case proto::V:
+    case proto::P: {
+      proto::PrevirtType buf;
+      codeInto<PrevirtType, proto::PrevirtType>(*this, buf);
+      return std::string(kind == proto::V ? "V:" : "P:")
+          + utohexstr(HashString(buf.SerializeAsString()));
+    }
     }
 
     return "?";
@@ -537,15 +835,14 @@ namespace previrt
   Function*
   PrevirtType::getEqualityFunction(Module* M) const
   {
-    switch (buffer.type()) {
+    switch (kind) {
     default:
       return NULL;
     case proto::N: {
       return NULL;
     }
     case proto::I: {
-      assert(buffer.int_().IsInitialized());
-      IntegerType* typ = Type::getIntNTy(M->getContext(), buffer.int_().bits());
+      IntegerType* typ = Type::getIntNTy(M->getContext(), flags);
       EqCache::iterator i = PrevirtType::cacheEq.find(typ);
       if (i != PrevirtType::cacheEq.end()) {
         return i->second;
@@ -557,7 +854,6 @@ namespace previrt
       return f;
     }
     case proto::S: {
-      assert(buffer.str().IsInitialized());
       PointerType* typ = Type::getInt8PtrTy(M->getContext());
       EqCache::iterator i = PrevirtType::cacheEq.find(typ);
       if (i != PrevirtType::cacheEq.end()) {
@@ -580,7 +876,56 @@ namespace previrt
         const previrt::proto::PrevirtType& buf, PrevirtType& result)
     {
       assert(buf.IsInitialized());
-      result.buffer.CopyFrom(buf);
+      result = PrevirtType();
+      result.kind = buf.type();
+      switch (buf.type()) {
+      default:
+        break;
+      case proto::I: {
+        const std::string& value = buf.int_().has_value() ? buf.int_().value() : "0";
+        result.flags = buf.int_().bits();
+        if (result.flags <= 64) {
+          result.word = APInt(result.flags, value, 16).getZExtValue();
+        } else {
+          result.str = PrevirtType::intern(value);
+        }
+        break;
+      }
+      case proto::F:
+        result.flags = buf.float_().sem();
+        result.str = PrevirtType::intern(buf.float_().data());
+        break;
+      case proto::S:
+        result.flags = buf.str().cstr();
+        result.str = PrevirtType::intern(buf.str().data());
+        break;
+      case proto::G:
+        if (buf.global().has_is_const()) {
+          result.flags = PrevirtType::G_VARIABLE
+              | (buf.global().is_const() ? PrevirtType::G_CONST : 0);
+        }
+        result.str = PrevirtType::intern(buf.global().name());
+        break;
+      case proto::V: {
+        auto vec = std::make_shared<PrevirtType::Aggregate>();
+        vec->elems.resize(buf.vec().elems_size());
+        for (int i = 0; i < buf.vec().elems_size(); ++i) {
+          codeInto<proto::PrevirtType, PrevirtType>(buf.vec().elems(i), vec->elems[i]);
+        }
+        result.agg = vec;
+        break;
+      }
+      case proto::P: {
+        auto ptr = std::make_shared<PrevirtType::Aggregate>();
+        ptr->elems.resize(1);
+        codeInto<proto::PrevirtType, PrevirtType>(buf.ptr().init(), ptr->elems[0]);
+        ptr->indices.assign(buf.ptr().indices().begin(), buf.ptr().indices().end());
+        result.flags = buf.ptr().is_local();
+        result.str = PrevirtType::intern(buf.ptr().name());
+        result.agg = ptr;
+        break;
+      }
+      }
     }
 
   template<>
@@ -588,7 +933,54 @@ namespace previrt
     codeInto<PrevirtType, proto::PrevirtType>(const PrevirtType& typ,
         proto::PrevirtType& buf)
     {
-      assert(typ.buffer.IsInitialized());
-      buf.CopyFrom(typ.buffer);
+      buf.Clear();
+      buf.set_type(typ.kind);
+      switch (typ.kind) {
+      default:
+        break;
+      case proto::I:
+        buf.mutable_int_()->set_bits(typ.flags);
+        buf.mutable_int_()->set_value(typ.flags <= 64
+            ? APInt(typ.flags, typ.word).toString(16, true) : typ.str.str());
+        break;
+      case proto::F:
+        buf.mutable_float_()->set_sem(proto::FloatSemantics(typ.flags));
+        buf.mutable_float_()->set_data(typ.str.str());
+        break;
+      case proto::S:
+        buf.mutable_str()->set_data(typ.str.str());
+        if (!typ.flags)
+          buf.mutable_str()->set_cstr(false);
+        break;
+      case proto::G:
+        buf.mutable_global()->set_name(typ.str.str());
+        if (typ.flags & PrevirtType::G_VARIABLE)
+          buf.mutable_global()->set_is_const(typ.flags & PrevirtType::G_CONST);
+        break;
+      case proto::V: {
+        auto* vec = buf.mutable_vec();
+        for (const PrevirtType& elem : typ.agg->elems) {
+          codeInto<PrevirtType, proto::PrevirtType>(elem, *vec->add_elems());
+        }
+        break;
+      }
+      case proto::P: {
+        auto* ptr = buf.mutable_ptr();
+        ptr->set_name(typ.str.str());
+        ptr->set_is_local(typ.flags);
+        codeInto<PrevirtType, proto::PrevirtType>(typ.agg->elems[0], *ptr->mutable_init());
+        for (uint64_t idx : typ.agg->indices) {
+          ptr->add_indices(idx);
+        }
+        break;
+      }
+      }
+      assert(buf.IsInitialized());
     }
+
+  PrevirtType::PrevirtType(const proto::PrevirtType& pt)
+    : PrevirtType()
+  {
+    codeInto<proto::PrevirtType, PrevirtType>(pt, *this);
+  }
 }
@@ -40,16 +40,27 @@
 #include "llvm/ADT/StringMap.h"
 
 #include "PrevirtualizeInterfaces.h"
+#include "FlatInterface.h"
 
 #include <vector>
 #include <string>
-#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
 
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
 
 using namespace llvm;
 
+static cl::opt<unsigned>
+InterfaceWiden("Pinterface-widen",
+	       cl::init(0),
+	       cl::Hidden,
+	       cl::desc("Widen the arguments of the calls to a function once it has more than this many distinct calls (0: never)"));
+
 namespace previrt
 {
   // CallInfo
@@ -94,6 +105,7 @@ namespace previrt
     codeInto<proto::CallInfo, CallInfo> (const proto::CallInfo& buf,
         CallInfo& ci)
     {
+      ci.count = buf.count();
       ci.args.clear();
       ci.args.reserve(buf.args_size());
       for (int i = 0; i < buf.args_size(); i++) {
@@ -134,6 +146,47 @@ namespace previrt
     return result;
   }
 
+  // Fact
+  bool
+  Fact::empty() const
+  {
+    return value.isUnknown() && !nonnull && bits == 0;
+  }
+
+  template<>
+    void
+    codeInto<Fact, proto::Fact> (const Fact& f, proto::Fact& buf)
+    {
+      if (!f.value.isUnknown()) {
+        codeInto<PrevirtType, proto::PrevirtType> (f.value, *buf.mutable_value());
+      }
+      if (f.nonnull) {
+        buf.set_nonnull(true);
+      }
+      if (f.bits != 0) {
+        buf.mutable_range()->set_bits(f.bits);
+        buf.mutable_range()->set_lo(f.lo);
+        buf.mutable_range()->set_hi(f.hi);
+      }
+    }
+
+  template<>
+    void
+    codeInto<proto::Fact, Fact> (const proto::Fact& buf, Fact& f)
+    {
+      f.value = PrevirtType::unknown();
+      if (buf.has_value()) {
+        codeInto<proto::PrevirtType, PrevirtType> (buf.value(), f.value);
+      }
+      f.nonnull = buf.nonnull();
+      f.bits = 0;
+      if (buf.has_range()) {
+        f.bits = buf.range().bits();
+        f.lo = buf.range().lo();
+        f.hi = buf.range().hi();
+      }
+    }
+
   // ComponentInterface
   ComponentInterface::ComponentInterface()
   {
@@ -150,60 +203,127 @@ namespace previrt
     }
   }
 
+  static bool
+  sameArgs(const std::vector<PrevirtType>& a, const std::vector<PrevirtType>& b)
+  {
+    if (a.size() != b.size())
+      return false;
+    for (unsigned i = 0, e = a.size(); i != e; ++i) {
+      if (a[i] != b[i])
+        return false;
+    }
+    return true;
+  }
+
+  // Hash of the distinct (w.r.t. operator==) values of args
+  static size_t
+  valuesHash(const std::vector<PrevirtType>& args)
+  {
+    std::vector<size_t> hashes;
+    for (unsigned i = 0, e = args.size(); i != e; ++i) {
+      bool seen = false;
+      for (unsigned j = 0; j < i && !seen; ++j) {
+        seen = (args[j] == args[i]);
+      }
+      if (!seen)
+        hashes.push_back(args[i].hash());
+    }
+    std::sort(hashes.begin(), hashes.end());
+    return hash_combine_range(hashes.begin(), hashes.end());
+  }
+
+  // Position of the first call in infos whose arguments only take
+  // values in candidates (distinct) and that satisfies match, or
+  // infos.size() if there is none.
+  template<typename Match>
+  static unsigned
+  findFirstCall(const std::unordered_multimap<size_t, unsigned>& index,
+                const std::vector<CallInfo*>& infos,
+                const std::vector<PrevirtType>& candidates, Match match)
+  {
+    assert(candidates.size() < 16);
+    unsigned best = infos.size();
+    for (unsigned mask = 0; mask < (1u << candidates.size()); ++mask) {
+      std::vector<PrevirtType> subset;
+      for (unsigned i = 0, e = candidates.size(); i != e; ++i) {
+        if (mask & (1u << i))
+          subset.push_back(candidates[i]);
+      }
+      auto r = index.equal_range(valuesHash(subset));
+      for (auto i = r.first; i != r.second; ++i) {
+        if (i->second < best && match(*infos[i->second]))
+          best = i->second;
+      }
+    }
+    return best;
+  }
+
+  ComponentInterface::CallIndex&
+  ComponentInterface::getIndex(StringRef f, const std::vector<CallInfo*>& infos)
+  {
+    CallIndex& idx = this->indexes[f];
+    for (; idx.size < infos.size(); ++idx.size) {
+      const std::vector<PrevirtType>& args = infos[idx.size]->args;
+      idx.exact.insert(std::make_pair(signature(f, args), idx.size));
+      idx.values.insert(std::make_pair(valuesHash(args), idx.size));
+    }
+    return idx;
+  }
+
   void
   ComponentInterface::call(FunctionHandle f, User::op_iterator args_begin,
       User::op_iterator args_end)
   {
-    if (this->calls.find(f) == this->calls.end()) {
-      std::vector<CallInfo*> calls;
-      calls.push_back(CallInfo::Create(args_begin, args_end, 1));
-      this->calls[f] = calls;
-    } else {
-      std::vector<CallInfo*>& calls = this->calls[f];
-      for (std::vector<CallInfo*>::const_iterator begin = calls.begin(), end =
-          calls.end(); begin != end; ++begin) {
-        User::op_iterator cur = args_begin;
-        for (std::vector<PrevirtType>::const_iterator i =
-            (*begin)->args.begin(), e = (*begin)->args.end(); i != e; ++i) {
-          if (i->refines(cur->get()) == NO_MATCH)
-            goto no;
-        }
-        (*begin)->count++;
+    std::vector<CallInfo*>& calls = this->calls[f];
+    if (!calls.empty()) {
+      // The call is counted in the first CallInfo whose arguments all
+      // refine the first argument of the callsite (the interfaces
+      // have always been built this way). Those arguments can only
+      // take the values that refine it.
+      const Value* first = args_begin->get();
+      std::vector<PrevirtType> candidates;
+      PrevirtType::refining(first, candidates);
+      unsigned pos = findFirstCall(getIndex(f, calls).values, calls, candidates,
+          [first](const CallInfo& ci) {
+            for (std::vector<PrevirtType>::const_iterator i = ci.args.begin(),
+                e = ci.args.end(); i != e; ++i) {
+              if (i->refines(first) == NO_MATCH)
+                return false;
+            }
+            return true;
+          });
+      if (pos < calls.size()) {
+        calls[pos]->count++;
         return;
-        no: continue;
       }
-
-      this->calls[f].push_back(CallInfo::Create(args_begin, args_end, 1));
     }
+    calls.push_back(CallInfo::Create(args_begin, args_end, 1));
   }
 
   void
   ComponentInterface::callAny(const Function* f)
   {
     FunctionHandle fname = f->getName();
-    if (this->calls.find(fname) == this->calls.end()) {
-      std::vector<CallInfo*> calls;
-      CallInfo* ci = CallInfo::Create(f->arg_size(), 1);
-      ci->args.resize(f->arg_size(), PrevirtType::unknown());
-      calls.push_back(ci);
-      this->calls[fname] = calls;
-    } else {
-      std::vector<CallInfo*>& calls = this->calls[fname];
-      for (std::vector<CallInfo*>::const_iterator begin = calls.begin(), end =
-          calls.end(); begin != end; ++begin) {
-        for (std::vector<PrevirtType>::const_iterator i =
-            (*begin)->args.begin(), e = (*begin)->args.end(); i != e; ++i) {
-          if (!i->isUnknown())
-            goto no;
-        }
-        (*begin)->count++;
+    std::vector<CallInfo*>& calls = this->calls[fname];
+    if (!calls.empty()) {
+      std::vector<PrevirtType> candidates(1, PrevirtType::unknown());
+      unsigned pos = findFirstCall(getIndex(fname, calls).values, calls, candidates,
+          [](const CallInfo& ci) {
+            for (std::vector<PrevirtType>::const_iterator i = ci.args.begin(),
+                e = ci.args.end(); i != e; ++i) {
+              if (!i->isUnknown())
+                return false;
+            }
+            return true;
+          });
+      if (pos < calls.size()) {
+        calls[pos]->count++;
         return;
-        no: continue;
       }
-      CallInfo* ci = CallInfo::Create(f->arg_size(), 1);
-      ci->args.resize(f->arg_size(), PrevirtType::unknown());
-      this->calls[fname].push_back(ci);
     }
+    CallInfo* ci = CallInfo::Create(f->arg_size(), 1);
+    ci->args.resize(f->arg_size(), PrevirtType::unknown());
+    calls.push_back(ci);
   }
 
   void
@@ -212,36 +332,225 @@ namespace previrt
     this->references.insert(n);
   }
 
+  void
+  ComponentInterface::define(StringRef f, const Fact& fact)
+  {
+    if (!fact.empty())
+      this->definitions[f] = fact;
+  }
+
+  void
+  ComponentInterface::defineGlobal(StringRef g, const Fact& fact)
+  {
+    if (!fact.empty())
+      this->globals[g] = fact;
+  }
+
   CallInfo*
   ComponentInterface::getOrCreateCall(FunctionHandle f, const std::vector<
       PrevirtType>& args)
   {
-    FunctionIterator itr = calls.find(f);
-    CallInfo* result;
-    if (itr == calls.end()) {
-      std::vector<CallInfo*> infos;
-      result = CallInfo::Create(args, 0);
-      infos.push_back(result);
-      calls[f] = infos;
-      return result;
-    } else {
-      for (CallIterator c = itr->second.begin(), e = itr->second.end(); c != e; ++c) {
-        if (args.size() != (*c)->args.size())
-          continue;
-        std::vector<PrevirtType>::const_iterator x = args.begin();
-        for (std::vector<PrevirtType>::const_iterator y = (*c)->args.begin(),
-            z = args.end(); x != z; ++x, ++y) {
-          if (*x != *y)
-            break;
+    std::vector<CallInfo*>& infos = calls[f];
+    CallIndex& idx = getIndex(f, infos);
+    unsigned pos = infos.size();
+    auto r = idx.exact.equal_range(signature(f, args));
+    for (auto i = r.first; i != r.second; ++i) {
+      if (i->second < pos && sameArgs(infos[i->second]->args, args))
+        pos = i->second;
+    }
+    if (pos < infos.size()) {
+      return infos[pos];
+    }
+    CallInfo* result = CallInfo::Create(args, 0);
+    infos.push_back(result);
+    return result;
+  }
+
+  hash_code
+  ComponentInterface::signature(StringRef f, const std::vector<PrevirtType>& args)
+  {
+    hash_code h = hash_combine(f, args.size());
+    for (std::vector<PrevirtType>::const_iterator i = args.begin(), e =
+        args.end(); i != e; ++i) {
+      h = hash_combine(h, i->hash());
+    }
+    return h;
+  }
+
+  bool
+  ComponentInterface::join(const std::vector<const ComponentInterface*>& others)
+  {
+    // index the calls of this interface by signature so that each
+    // call of the others is matched in constant time. The names are
+    // the keys of this->calls, which do not move.
+    typedef std::pair<StringRef, CallInfo*> IndexEntry;
+    typedef std::unordered_multimap<size_t, IndexEntry> SignatureIndex;
+    SignatureIndex index;
+    for (FunctionIterator f = this->calls.begin(), fe = this->calls.end();
+         f != fe; ++f) {
+      for (CallIterator c = f->second.begin(), ce = f->second.end(); c != ce; ++c) {
+        index.insert(std::make_pair(signature(f->first(), (*c)->args),
+                                    IndexEntry(f->first(), *c)));
+      }
+    }
+
+    bool changed = false;
+    for (std::vector<const ComponentInterface*>::const_iterator o =
+        others.begin(), oe = others.end(); o != oe; ++o) {
+      for (FunctionIterator f = (*o)->calls.begin(), fe = (*o)->calls.end();
+           f != fe; ++f) {
+        for (CallIterator c = f->second.begin(), ce = f->second.end(); c != ce; ++c) {
+          size_t h = signature(f->first(), (*c)->args);
+          CallInfo* found = nullptr;
+          std::pair<SignatureIndex::iterator, SignatureIndex::iterator> r =
+              index.equal_range(h);
+          for (SignatureIndex::iterator i = r.first; i != r.second; ++i) {
+            if (i->second.first == f->first() &&
+                sameArgs(i->second.second->args, (*c)->args)) {
+              found = i->second.second;
+              break;
+            }
+          }
+          if (found) {
+            found->count += (*c)->count;
+          } else {
+            CallInfo* ci = CallInfo::Create((*c)->args, (*c)->count);
+            std::vector<CallInfo*>& infos = this->calls[f->first()];
+            infos.push_back(ci);
+            StringRef name = this->calls.find(f->first())->first();
+            index.insert(std::make_pair(h, IndexEntry(name, ci)));
+            changed = true;
+          }
         }
-        if (x == args.end()) {
-          return *c;
+      }
+      for (std::set<std::string>::const_iterator i = (*o)->references.begin(),
+             e = (*o)->references.end(); i != e; ++i) {
+        changed |= this->references.insert(*i).second;
+      }
+      // a symbol is defined by one module so there is nothing to merge
+      this->definitions.insert((*o)->definitions.begin(), (*o)->definitions.end());
+      this->globals.insert((*o)->globals.begin(), (*o)->globals.end());
+    }
+    return changed;
+  }
+
+  bool
+  ComponentInterface::join(const ComponentInterface& other)
+  {
+    std::vector<const ComponentInterface*> others;
+    others.push_back(&other);
+    return join(others);
+  }
+
+  // Merge the calls with the same arguments into the first one
+  static void
+  mergeCalls(std::vector<CallInfo*>& infos)
+  {
+    std::unordered_multimap<size_t, unsigned> seen;
+    unsigned kept = 0;
+    for (unsigned i = 0, e = infos.size(); i != e; ++i) {
+      CallInfo* ci = infos[i];
+      size_t h = ComponentInterface::signature("", ci->args);
+      CallInfo* same = nullptr;
+      auto r = seen.equal_range(h);
+      for (auto j = r.first; j != r.second && !same; ++j) {
+        if (sameArgs(infos[j->second]->args, ci->args))
+          same = infos[j->second];
+      }
+      if (same) {
+        same->count += ci->count;
+        delete ci;
+      } else {
+        seen.insert(std::make_pair(h, kept));
+        infos[kept++] = ci;
+      }
+    }
+    infos.resize(kept);
+  }
+
+  bool
+  ComponentInterface::widen(unsigned limit, WidenStats& stats)
+  {
+    if (limit == 0)
+      return false;
+
+    bool changed = false;
+    for (StringMap<std::vector<CallInfo*> >::iterator f = this->calls.begin(),
+           fe = this->calls.end(); f != fe; ++f) {
+      std::vector<CallInfo*>& infos = f->second;
+      if (infos.size() <= limit)
+        continue;
+
+      // number of distinct values at each argument position
+      std::vector<std::pair<unsigned, unsigned> > positions;
+      for (unsigned pos = 0; ; ++pos) {
+        std::unordered_multimap<size_t, const PrevirtType*> values;
+        bool present = false;
+        for (std::vector<CallInfo*>::const_iterator c = infos.begin(),
+               ce = infos.end(); c != ce; ++c) {
+          if (pos >= (*c)->args.size())
+            continue;
+          present = true;
+          const PrevirtType& v = (*c)->args[pos];
+          size_t h = v.hash();
+          bool found = false;
+          auto r = values.equal_range(h);
+          for (auto i = r.first; i != r.second && !found; ++i) {
+            found = (*i->second == v);
+          }
+          if (!found)
+            values.insert(std::make_pair(h, &v));
         }
+        if (!present)
+          break;
+        if (values.size() > 1)
+          positions.push_back(std::make_pair(values.size(), pos));
+      }
+      // most distinct values first, then leftmost
+      std::sort(positions.begin(), positions.end(),
+                [](const std::pair<unsigned, unsigned>& a,
+                   const std::pair<unsigned, unsigned>& b) {
+                  return a.first > b.first ||
+                      (a.first == b.first && a.second < b.second);
+                });
+
+      const unsigned before = infos.size();
+      unsigned widened = 0;
+      for (unsigned i = 0, e = positions.size(); i != e && infos.size() > limit; ++i) {
+        const unsigned pos = positions[i].second;
+        for (std::vector<CallInfo*>::iterator c = infos.begin(),
+               ce = infos.end(); c != ce; ++c) {
+          if (pos < (*c)->args.size())
+            (*c)->args[pos] = PrevirtType::unknown();
+        }
+        mergeCalls(infos);
+        ++widened;
+      }
+
+      if (widened > 0) {
+        // the positions of the calls have changed
+        this->indexes.erase(f->first());
+        stats.functions++;
+        stats.before += before;
+        stats.after += infos.size();
+        stats.args += widened;
+        changed = true;
       }
-      result = CallInfo::Create(args, 0);
-      calls[f].push_back(result);
-      return result;
     }
+    return changed;
+  }
+
+  bool
+  ComponentInterface::widen(WidenStats& stats)
+  {
+    return widen(InterfaceWiden, stats);
+  }
+
+  void
+  WidenStats::print(raw_ostream& o) const
+  {
+    o << "widened " << args << " argument positions of " << functions
+      << " functions: " << before << " calls -> " << after << " calls\n";
   }
 
   void
@@ -256,6 +565,15 @@ namespace previrt
     for (std::set<std::string>::const_iterator i = this->references.begin(), e = this->references.end(); i != e; ++i) {
       errs() << "ref '" << *i << "'\n";
     }
+
+    for (std::map<std::string, Fact>::const_iterator i = this->definitions.begin(), e = this->definitions.end(); i != e; ++i) {
+      errs() << "returns '" << i->first << "' " << i->second.value.to_string()
+             << (i->second.nonnull ? " nonnull" : "") << "\n";
+    }
+
+    for (std::map<std::string, Fact>::const_iterator i = this->globals.begin(), e = this->globals.end(); i != e; ++i) {
+      errs() << "global '" << i->first << "' " << i->second.value.to_string() << "\n";
+    }
   }
 
   ComponentInterface::FunctionIterator
@@ -322,6 +640,18 @@ namespace previrt
           ci.references.end(); i != e; ++i) {
         buf.add_references(*i);
       }
+      for (std::map<std::string, Fact>::const_iterator i = ci.definitions.begin(),
+          e = ci.definitions.end(); i != e; ++i) {
+        proto::Fact* fact = buf.add_definitions();
+        fact->set_name(i->first);
+        codeInto<Fact, proto::Fact> (i->second, *fact);
+      }
+      for (std::map<std::string, Fact>::const_iterator i = ci.globals.begin(),
+          e = ci.globals.end(); i != e; ++i) {
+        proto::Fact* fact = buf.add_globals();
+        fact->set_name(i->first);
+        codeInto<Fact, proto::Fact> (i->second, *fact);
+      }
     }
 
   template<>
@@ -348,26 +678,52 @@ namespace previrt
           i = buf.references().begin(), e = buf.references().end(); i != e; ++i) {
         ci.references.insert(*i);
       }
+      for (int i = 0; i < buf.definitions_size(); i++) {
+        codeInto<proto::Fact, Fact> (buf.definitions(i), ci.definitions[buf.definitions(i).name()]);
+      }
+      for (int i = 0; i < buf.globals_size(); i++) {
+        codeInto<proto::Fact, Fact> (buf.globals(i), ci.globals[buf.globals(i).name()]);
+      }
     }
 
-  bool
-  ComponentInterface::readFromFile(const std::string& filename)
+  // Read filename into result, from the flat format with loadFlat or
+  // from the protobuf message Buf. The file is mapped in memory.
+  template<typename Buf, typename T, typename LoadFlat>
+  static bool
+  readFile(const std::string& filename, T& result, LoadFlat loadFlat)
   {
     assert(filename != "");
-    std::ifstream input(filename.c_str(), std::ios::binary);
-    if (input.fail()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+        MemoryBuffer::getFile(filename, -1, false);
+    if (!buffer) {
       return false;
     }
-    proto::ComponentInterface buf;
-    if (!buf.ParseFromIstream(&input)) {
-      input.close();
+    if (FlatInterface::isFlat((*buffer)->getBuffer())) {
+      std::unique_ptr<FlatInterface> flat = FlatInterface::open(std::move(*buffer));
+      if (!flat) {
+        return false;
+      }
+      loadFlat(*flat, result);
+      return true;
+    }
+    Buf buf;
+    if (!buf.ParseFromArray((*buffer)->getBufferStart(),
+                            (*buffer)->getBufferSize())) {
       return false;
     }
-    codeInto<proto::ComponentInterface, ComponentInterface> (buf, *this);
-    input.close();
+    codeInto<Buf, T> (buf, result);
     return true;
   }
 
+  bool
+  ComponentInterface::readFromFile(const std::string& filename)
+  {
+    return readFile<proto::ComponentInterface>(filename, *this,
+        [](const FlatInterface& flat, ComponentInterface& ci) {
+          flat.load(ci);
+        });
+  }
+
   // CallRewrite
   CallRewrite::CallRewrite(FunctionHandle h, const std::vector<unsigned>& a) :
     function(h), args(a)
@@ -583,43 +939,145 @@ namespace previrt
     return &(c->second);
   }
 
+  // RewriteTable
+  RewriteTable::RewriteTable(const ComponentInterfaceTransform& T)
+  {
+    assert(T.interface != NULL);
+    for (ComponentInterfaceTransform::FMap::const_iterator f = T.rewrites.begin(),
+           fe = T.rewrites.end(); f != fe; ++f) {
+      ComponentInterface::FunctionIterator calls = T.interface->find(f->first);
+      if (calls == T.interface->end())
+        continue;
+
+      Table& table = this->tables[f->first];
+      const unsigned n = calls->second.size();
+      for (unsigned i = 0; i != n; ++i) {
+        const CallInfo* ci = calls->second[i];
+        const unsigned arity = ci->args.size();
+
+        Entry entry;
+        entry.rewrite = T.lookupRewrite(f->first, ci);
+        entry.kept.resize(arity);
+        if (entry.rewrite != NULL) {
+          for (std::vector<unsigned>::const_iterator a = entry.rewrite->args.begin(),
+                 ae = entry.rewrite->args.end(); a != ae; ++a) {
+            if (*a < arity)
+              entry.kept.set(*a);
+          }
+        }
+        table.entries.push_back(entry);
+
+        // the score of CallInfo::refines when all the arguments match
+        unsigned score = 0;
+        for (unsigned a = 0; a != arity; ++a) {
+          score += ci->args[a].isUnknown() ? LOOSE_MATCH : EXACT_MATCH;
+        }
+        table.scores.push_back(score);
+
+        table.arities[arity].push_back(i);
+        if (table.positions.size() < arity)
+          table.positions.resize(arity);
+        for (unsigned a = 0; a != arity; ++a) {
+          table.positions[a][ci->args[a]].push_back(i);
+        }
+      }
+    }
+  }
+
+  // Position of the call with the best score among those whose
+  // arguments are in candidates, the first one if there are several,
+  // or -1 if there is none.
+  int
+  RewriteTable::decide(const Table& table, const Candidates& candidates)
+  {
+    std::map<unsigned, CallList>::const_iterator arity =
+        table.arities.find(candidates.size());
+    if (arity == table.arities.end())
+      return -1;
+
+    CallList matched = arity->second;
+    for (unsigned a = 0, e = candidates.size(); a != e && !matched.empty(); ++a) {
+      CallList refined;
+      for (std::vector<PrevirtType>::const_iterator t = candidates[a].begin(),
+             te = candidates[a].end(); t != te; ++t) {
+        ValueMap::const_iterator calls = table.positions[a].find(*t);
+        if (calls != table.positions[a].end())
+          refined.insert(refined.end(), calls->second.begin(), calls->second.end());
+      }
+      // a call has one value at each position so there are no duplicates
+      std::sort(refined.begin(), refined.end());
+      CallList both;
+      std::set_intersection(matched.begin(), matched.end(),
+                            refined.begin(), refined.end(),
+                            std::back_inserter(both));
+      matched.swap(both);
+    }
+
+    int best = -1;
+    for (CallList::const_iterator i = matched.begin(), e = matched.end(); i != e; ++i) {
+      if (best == -1 || table.scores[*i] > table.scores[best])
+        best = *i;
+    }
+    return best;
+  }
+
+  const RewriteTable::Entry*
+  RewriteTable::lookup(StringRef f, User::op_iterator op_begin,
+                       User::op_iterator op_end)
+  {
+    StringMap<Table>::iterator t = this->tables.find(f);
+    if (t == this->tables.end())
+      return NULL;
+    Table& table = t->second;
+
+    Candidates candidates;
+    hash_code h = hash_combine(op_end - op_begin);
+    for (; op_begin != op_end; ++op_begin) {
+      candidates.push_back(std::vector<PrevirtType>());
+      PrevirtType::refining(op_begin->get(), candidates.back());
+      for (std::vector<PrevirtType>::const_iterator c = candidates.back().begin(),
+             ce = candidates.back().end(); c != ce; ++c) {
+        h = hash_combine(h, c->hash());
+      }
+    }
+
+    int pos = -2;
+    auto r = table.memo.equal_range(h);
+    for (auto i = r.first; i != r.second && pos == -2; ++i) {
+      if (i->second.first == candidates)
+        pos = i->second.second;
+    }
+    if (pos == -2) {
+      pos = decide(table, candidates);
+      table.memo.insert(std::make_pair(h, std::make_pair(candidates, pos)));
+    }
+
+    if (pos < 0 || table.entries[pos].rewrite == NULL)
+      return NULL;
+    return &table.entries[pos];
+  }
+
   bool
   ComponentInterfaceTransform::readInterfaceFromFile(
       const std::string& filename)
   {
-    assert(filename != "");
-    std::ifstream input(filename.c_str(), std::ios::binary);
-    if (input.fail()) {
-      return false;
-    }
-    proto::ComponentInterface buf;
-    if (!buf.ParseFromIstream(&input)) {
-      input.close();
-      return false;
-    }
-    codeInto<proto::ComponentInterface, ComponentInterfaceTransform> (buf,
-        *this);
-    input.close();
-    return true;
+    return readFile<proto::ComponentInterface>(filename, *this,
+        [](const FlatInterface& flat, ComponentInterfaceTransform& rw) {
+          if (rw.interface == NULL) {
+            rw.ownsIface = true;
+            rw.interface = new ComponentInterface();
+          }
+          flat.load(*rw.interface);
+        });
   }
 
   bool
   ComponentInterfaceTransform::readTransformFromFile(
       const std::string& filename)
   {
-    assert(filename != "");
-    std::ifstream input(filename.c_str(), std::ios::binary);
-    if (input.fail()) {
-      return false;
-    }
-    proto::ComponentInterfaceTransform buf;
-    if (!buf.ParseFromIstream(&input)) {
-      input.close();
-      return false;
-    }
-    codeInto<proto::ComponentInterfaceTransform, ComponentInterfaceTransform> (
-        buf, *this);
-    input.close();
-    return true;
+    return readFile<proto::ComponentInterfaceTransform>(filename, *this,
+        [](const FlatInterface& flat, ComponentInterfaceTransform& rw) {
+          flat.load(rw);
+        });
   }
 }
@@ -0,0 +1,207 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "ProfileSpecPolicy.h"
+#include "Specializer.h"
+#include "llvm/ADT/SmallBitVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+using namespace llvm;
+
+#define PSP_LOG(...) __VA_ARGS__
+//#define PSP_LOG(...)
+
+namespace previrt {
+
+  static std::string callKey(StringRef file, unsigned line, StringRef callee) {
+    return (sys::path::filename(file) + ":" + Twine(line) + " " + callee).str();
+  }
+
+  // Parse <file>:<line>[:<column>]. The column is 0 if missing.
+  static bool parseLocation(StringRef loc, StringRef& file,
+			    unsigned& line, unsigned& column) {
+    SmallVector<StringRef, 3> parts;
+    loc.split(parts, ':');
+    if (parts.size() < 2 || parts.size() > 3 || parts[0].empty()) {
+      return false;
+    }
+    file = parts[0];
+    column = 0;
+    if (parts[1].getAsInteger(10, line)) {
+      return false;
+    }
+    return parts.size() == 2 || !parts[2].getAsInteger(10, column);
+  }
+  
+  ProfileSpecPolicy::ProfileSpecPolicy(std::unique_ptr<SpecializationPolicy> subpolicy,
+				       const std::string& profile,
+				       unsigned min_count, unsigned min_percent)
+    : m_subpolicy(std::move(subpolicy))
+    , m_min_count(min_count)
+    , m_min_percent(min_percent) {
+    if (!readProfile(profile)) {
+      errs() << "Warning: cannot read value profile " << profile << "\n";
+    }
+  }
+
+  bool ProfileSpecPolicy::readProfile(const std::string& filename) {
+    std::ifstream in(filename.c_str());
+    if (!in.is_open()) {
+      return false;
+    }
+    std::string line;
+    unsigned lineno = 0;
+    while (std::getline(in, line)) {
+      lineno++;
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream fields(line);
+      std::string loc, callee;
+      unsigned arg;
+      int64_t value;
+      uint64_t count;
+      StringRef file;
+      unsigned srcLine, column;
+      if (!(fields >> loc >> callee >> arg >> value >> count) ||
+	  !parseLocation(loc, file, srcLine, column)) {
+	errs() << filename << ":" << lineno << ": ignored malformed entry\n";
+	continue;
+      }
+      ArgProfile& p = m_calls[callKey(file, srcLine, callee)][column][arg];
+      p.total += count;
+      p.values[value] += count;
+    }
+
+    // -- number of calls to each callee: every argument of a call
+    //    site counts the same calls so take the largest one.
+    for (auto const& kv: m_calls) {
+      StringRef callee = kv.first().split(' ').second;
+      for (auto const& site: kv.second) {
+	uint64_t calls = 0;
+	for (auto const& args: site.second) {
+	  calls = std::max(calls, args.second.total);
+	}
+	m_callees[callee] += calls;
+      }
+    }
+    return true;
+  }
+  
+  bool ProfileSpecPolicy::intraSpecializeOn(CallSite CS,
+					    std::vector<Value*>& marks) {
+    const Function* calleeF = CS.getCalledFunction();
+    if (!calleeF) {
+      return false;
+    }
+
+    bool specialize = m_subpolicy->intraSpecializeOn(CS, marks);
+    if (marks.size() != CS.arg_size()) {
+      marks.assign(CS.arg_size(), nullptr);
+    }
+    
+    // -- the guard is only for calls, and is never nested
+    if (!isa<CallInst>(CS.getInstruction()) ||
+	cast<CallInst>(CS.getInstruction())->isMustTailCall() ||
+	isGuardFallback(CS.getInstruction())) {
+      return specialize;
+    }
+    
+    const DILocation* loc = CS.getInstruction()->getDebugLoc().get();
+    if (!loc) {
+      return specialize;
+    }
+    auto it = m_calls.find(callKey(loc->getFilename(), loc->getLine(),
+				   calleeF->getName()));
+    if (it == m_calls.end()) {
+      return specialize;
+    }
+    // -- the entry for the column, or else for the whole line
+    auto sit = it->second.find(loc->getColumn());
+    if (sit == it->second.end()) {
+      sit = it->second.find(0);
+    }
+    if (sit == it->second.end()) {
+      return specialize;
+    }
+
+    for (auto const& kv: sit->second) {
+      const unsigned i = kv.first;
+      const ArgProfile& p = kv.second;
+      if (i >= CS.arg_size() || marks[i] ||
+	  !CS.getArgument(i)->getType()->isIntegerTy()) {
+	continue;
+      }
+      if (p.total < m_min_count) {
+	continue;
+      }
+      // -- dominant value
+      auto best = p.values.begin();
+      for (auto vi = p.values.begin(), ve = p.values.end(); vi != ve; ++vi) {
+	if (vi->second > best->second) {
+	  best = vi;
+	}
+      }
+      if (best->second * 100 < p.total * m_min_percent) {
+	continue;
+      }
+      marks[i] = ConstantInt::get(CS.getArgument(i)->getType(), best->first, true);
+      specialize = true;
+      PSP_LOG(errs() << "[PSP] call to " << calleeF->getName() << " at "
+	      << sys::path::filename(loc->getFilename()) << ":"
+	      << loc->getLine() << ":" << loc->getColumn()
+	      << " with argument " << i << " = "
+	      << best->first << " in " << best->second << "/" << p.total
+	      << " calls\n";);
+    }
+    return specialize;
+  }
+  
+  bool ProfileSpecPolicy::interSpecializeOn(const Function& calleeF,
+					    const std::vector<PrevirtType>& args,
+					    const ComponentInterface& interface,
+					    SmallBitVector& marks)  {
+    auto it = m_callees.find(calleeF.getName());
+    if (it == m_callees.end() || it->second < m_min_count) {
+      return false;
+    }
+    return m_subpolicy->interSpecializeOn(calleeF, args, interface, marks);
+  }
+  
+} // end namespace
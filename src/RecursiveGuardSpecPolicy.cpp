@@ -32,20 +32,34 @@
 //
 
 #include "RecursiveGuardSpecPolicy.h"
+#include "SpecializationTable.h"
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/SmallBitVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
 
 using namespace llvm;
 
+#define RGSP_LOG(...) __VA_ARGS__
+//#define RGSP_LOG(...)
+
 namespace previrt {
   
   RecursiveGuardSpecPolicy::
   RecursiveGuardSpecPolicy(std::unique_ptr<SpecializationPolicy> subpolicy,
-			   CallGraph& cg)
+			   CallGraph& cg, bool unfold, unsigned max_depth)
     : m_cg(cg)
-    , m_subpolicy(std::move(subpolicy)) {
+    , m_subpolicy(std::move(subpolicy))
+    , m_unfold(unfold)
+    , m_max_depth(max_depth) {
     
     markRecursiveFunctions();
+    if (m_unfold) {
+      countUnfoldings();
+    }
   }
   
   void RecursiveGuardSpecPolicy::markRecursiveFunctions() {
@@ -62,12 +76,76 @@ namespace previrt {
       }
 
       if (recursive) {
+	std::vector<Function*> fns;
 	for (CallGraphNode *cgn : scc) {
 	  Function *fn = cgn->getFunction();
 	  if (!fn || fn->isDeclaration() || fn->empty()) {
 	    continue;
 	  }
 	  m_rec_functions.insert(fn);
+	  fns.push_back(fn);
+	}
+	if (m_unfold) {
+	  markInvariantArguments(fns);
+	}
+      }
+    }
+  }
+
+  // Greatest fixpoint: start with all the parameters of the SCC and
+  // remove the ones that some call inside the SCC does not pass
+  // unchanged from an invariant parameter of the caller.
+  void RecursiveGuardSpecPolicy::
+  markInvariantArguments(const std::vector<Function*>& scc) {
+    SmallPtrSet<const Function*, 8> members(scc.begin(), scc.end());
+    for (Function* fn: scc) {
+      m_invariant[fn] = SmallBitVector(fn->arg_size(), true);
+    }
+
+    bool change = true;
+    while (change) {
+      change = false;
+      for (Function* fn: scc) {
+	const SmallBitVector& callerInv = m_invariant.find(fn)->second;
+	for (BasicBlock& bb: *fn) {
+	  for (Instruction& I: bb) {
+	    CallSite CS(&I);
+	    if (!CS) continue;
+	    const Function* callee = CS.getCalledFunction();
+	    if (!callee || !members.count(callee)) continue;
+	    SmallBitVector& inv = m_invariant.find(callee)->second;
+	    for (unsigned i = 0, e = inv.size(); i < e; ++i) {
+	      if (!inv.test(i)) continue;
+	      const Argument* a = nullptr;
+	      if (i < CS.arg_size()) {
+		a = dyn_cast<Argument>(CS.getArgument(i));
+	      }
+	      if (!a || !callerInv.test(a->getArgNo())) {
+		inv.reset(i);
+		change = true;
+	      }
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  // The copies made by previous runs on the module count as
+  // unfoldings too.
+  void RecursiveGuardSpecPolicy::countUnfoldings() {
+    SpecializationTable table(&m_cg.getModule());
+    for (auto const& kv: table) {
+      const SpecializationTable::Specialization* spec = kv.second;
+      if (spec->parent == nullptr) continue;
+      const Function* f = spec->parent->handle;
+      auto it = m_invariant.find(f);
+      if (it == m_invariant.end()) continue;
+      m_copies[f].insert(spec->args);
+      for (unsigned i = 0, e = spec->args.size(); i < e; ++i) {
+	if (spec->args[i] && (i >= it->second.size() || !it->second.test(i))) {
+	  m_unfolded[f]++;
+	  break;
 	}
       }
     }
@@ -82,6 +160,27 @@ namespace previrt {
     return (!isRecursive(F));
   }
 
+  bool RecursiveGuardSpecPolicy::
+  restrictMarks(const Function& F, SmallBitVector& marks,
+		const std::function<bool(const SmallBitVector&)>& hasCopy) {
+    const SmallBitVector& inv = m_invariant.find(&F)->second;
+    SmallBitVector varying(marks);
+    for (unsigned i = 0, e = std::min(inv.size(), varying.size()); i < e; ++i) {
+      if (inv.test(i)) varying.reset(i);
+    }
+    if (varying.any() && !hasCopy(marks)) {
+      unsigned& unfolded = m_unfolded[&F];
+      if (unfolded < m_max_depth) {
+	++unfolded;
+	RGSP_LOG(errs() << "[RGSP] unfolding " << F.getName() << " ("
+		 << unfolded << "/" << m_max_depth << ")\n";);
+      } else {
+	marks.reset(varying);
+      }
+    }
+    return marks.any();
+  }
+
   bool RecursiveGuardSpecPolicy::intraSpecializeOn(CallSite CS,
 						   std::vector<Value*>& marks) {
     const Function* calleeF = CS.getCalledFunction();
@@ -91,6 +190,31 @@ namespace previrt {
     
     if (allowSpecialization(*calleeF)) {
       return m_subpolicy->intraSpecializeOn(CS, marks);
+    } else if (m_unfold) {
+      if (!m_subpolicy->intraSpecializeOn(CS, marks)) {
+	return false;
+      }
+      SmallBitVector bits(marks.size());
+      for (unsigned i = 0, e = marks.size(); i < e; ++i) {
+	if (marks[i]) bits.set(i);
+      }
+      std::set<SpecScheme>& copies = m_copies[calleeF];
+      auto scheme = [&marks](const SmallBitVector& keep) {
+	SpecScheme s(marks);
+	for (unsigned i = 0, e = s.size(); i < e; ++i) {
+	  if (!keep.test(i)) s[i] = nullptr;
+	}
+	return s;
+      };
+      auto hasCopy = [&copies, &scheme](const SmallBitVector& keep) {
+	return copies.count(scheme(keep)) > 0;
+      };
+      if (!restrictMarks(*calleeF, bits, hasCopy)) {
+	return false;
+      }
+      marks = scheme(bits);
+      copies.insert(marks);
+      return true;
     } else {
       return false;
     }
@@ -102,6 +226,48 @@ namespace previrt {
 						   SmallBitVector& marks)  {
     if (allowSpecialization(CalleeF)) {
       return m_subpolicy->interSpecializeOn(CalleeF, args, interface, marks);
+    } else if (m_unfold) {
+      if (!m_subpolicy->interSpecializeOn(CalleeF, args, interface, marks)) {
+	return false;
+      }
+      std::vector<std::vector<PrevirtType>>& inter_copies = m_inter_copies[&CalleeF];
+      const std::set<SpecScheme>& copies = m_copies[&CalleeF];
+      auto scheme = [&args](const SmallBitVector& keep) {
+	std::vector<PrevirtType> s(args.size(), PrevirtType::unknown());
+	for (unsigned i = 0, e = s.size(); i < e; ++i) {
+	  if (i < keep.size() && keep.test(i)) s[i] = args[i];
+	}
+	return s;
+      };
+      auto hasCopy = [&](const SmallBitVector& keep) {
+	if (std::find(inter_copies.begin(), inter_copies.end(), scheme(keep))
+	    != inter_copies.end()) {
+	  return true;
+	}
+	// -- copies made by previous runs are only known by their
+	//    constant arguments
+	for (const SpecScheme& copy: copies) {
+	  if (copy.size() != args.size()) continue;
+	  bool same = true;
+	  for (unsigned i = 0, e = copy.size(); same && i < e; ++i) {
+	    if (i < keep.size() && keep.test(i)) {
+	      same = copy[i] && args[i].refines(copy[i]) == EXACT_MATCH;
+	    } else {
+	      same = !copy[i];
+	    }
+	  }
+	  if (same) return true;
+	}
+	return false;
+      };
+      if (!restrictMarks(CalleeF, marks, hasCopy)) {
+	return false;
+      }
+      std::vector<PrevirtType> s = scheme(marks);
+      if (std::find(inter_copies.begin(), inter_copies.end(), s) == inter_copies.end()) {
+	inter_copies.push_back(s);
+      }
+      return true;
     } else {
       return false;
     }
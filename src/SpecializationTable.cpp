@@ -42,8 +42,11 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+
 using namespace llvm;
 
 namespace previrt
@@ -51,8 +54,13 @@ namespace previrt
   
   typedef SpecializationTable::Specialization Specialization;
 
+  // Named metadata with one entry per specialization:
+  //   !{parent, specialization, arg_0, ..., arg_n}
+  // where arg_i is either a constant or "?" if not specialized.
+  static const char* const spec_table_md = "previrt::specializations";
+
   /* Return true if l refines r */
-  bool Specialization::refines(SpecScheme l, SpecScheme r) {
+  bool Specialization::refines(ArrayRef<Value*> l, ArrayRef<Value*> r) {
     assert(l.size() == r.size());
     for (unsigned i = 0, e = l.size(); i < e; i++) {
       if (!r[i])
@@ -73,59 +81,66 @@ namespace previrt
   }
 
   void SpecializationTable::initialize(Module* m) {
-    // XXX: RECORD_IN_METADATA seems an old option.
-    //      TODO: figure out if we can remove this code.
     assert(this->module == NULL);
     
     this->module = m;
-#ifdef RECORD_IN_METADATA
-    // Parse the module metadata to populate the table
-    NamedMDNode* specs = m->getNamedMetadata("previrt::specializations");
-    if (specs == NULL)
-    return;
 
-    errs() << "Specialization Count: " << specs->getNumOperands() << "\n";
+    // -- Reload the specializations recorded by previous runs. An
+    //    entry is dropped if one of its functions or constants has
+    //    been deleted since then.
+    NamedMDNode* specs = m->getNamedMetadata(spec_table_md);
+    if (specs == NULL) {
+      return;
+    }
 
+    std::vector<MDNode*> live;
     for (unsigned int i = 0; i < specs->getNumOperands(); ++i) {
-      MDNode* funNode = specs->getOperand(i);
-      if (funNode == NULL) {
-        continue;
-      }
-      assert (funNode->getNumOperands() > 2);
-      MDString* prinName = dyn_cast_or_null<MDString>(funNode->getOperand(0));
-      MDString* specName = dyn_cast_or_null<MDString>(funNode->getOperand(1));
-      if (prinName == NULL || specName == NULL) {
-        errs() << "must skip " << (prinName == NULL ? "?" : prinName->getString()) << "\n";
+      MDNode* node = specs->getOperand(i);
+      if (node == NULL || node->getNumOperands() < 2) {
         continue;
       }
-      Function* prin = m->getFunction(prinName->getString());
-      Function* spec = m->getFunction(specName->getString());
-      if (prin == NULL || spec == NULL) {
-        errs() << "must skip " << (prin == NULL ? "?" : prin->getName()) << "\n";
+      Function* parent = mdconst::dyn_extract_or_null<Function>(node->getOperand(0));
+      Function* spec = mdconst::dyn_extract_or_null<Function>(node->getOperand(1));
+      if (parent == NULL || spec == NULL) {
         continue;
       }
 
-      const unsigned int arg_count = prin->getArgumentList().size();
-      if (funNode->getNumOperands() != 2 + arg_count) {
+      const unsigned int arg_count = parent->arg_size();
+      if (node->getNumOperands() != 2 + arg_count) {
         continue;
       }
-      
+
       SpecScheme scheme;
       scheme.reserve(arg_count);
-      for (unsigned int i = 0; i < arg_count; i++) {
-        Value* opr = funNode->getOperand(2 + i);
-        if (opr == NULL) {
+      for (unsigned int j = 0; j < arg_count; j++) {
+        const MDOperand& opr = node->getOperand(2 + j);
+        if (dyn_cast_or_null<MDString>(opr.get())) {
           scheme.push_back(nullptr);
+        } else if (Constant* c = mdconst::dyn_extract_or_null<Constant>(opr)) {
+          scheme.push_back(c);
         } else {
-          assert (dyn_cast<Constant>(opr) != NULL);
-          scheme.push_pack(opr);
+          break;
         }
       }
+      if (scheme.size() != arg_count) {
+        continue;
+      }
 
-      this->addSpecialization(prin, scheme, spec, false);
-      errs() << "recording specialization of '" << prin->getName() << "' to '" << spec->getName() << "'\n";
+      if (this->addSpecialization(parent, scheme, spec, false)) {
+        live.push_back(node);
+      }
+    }
+
+    // -- Otherwise the entries of deleted functions would accumulate
+    //    across the runs on the module.
+    if (live.empty()) {
+      specs->eraseFromParent();
+    } else if (live.size() != specs->getNumOperands()) {
+      specs->clearOperands();
+      for (MDNode* node: live) {
+        specs->addOperand(node);
+      }
     }
-#endif /* RECORD_IN_METADATA */
   }
 
   SpecializationTable::~SpecializationTable() {
@@ -136,19 +151,52 @@ namespace previrt
   }
 
 
-  void SpecializationTable::getSpecializations(Function* f, SpecScheme scheme,
+  /* Collect the leaves below node whose schemes refine scheme[depth:] */
+  static void collectRefined(const SpecializationTable::SchemeTrie& node,
+			     ArrayRef<Value*> scheme, unsigned depth,
+			     std::vector<const Specialization*>& result) {
+    if (depth == scheme.size()) {
+      result.insert(result.end(), node.leaves.begin(), node.leaves.end());
+      return;
+    }
+    if (Value* v = scheme[depth]) {
+      // only the children with the same constant refine the scheme
+      auto it = node.next.find(v);
+      if (it != node.next.end()) {
+	collectRefined(*(it->second), scheme, depth + 1, result);
+      }
+    } else {
+      for (auto &kv: node.next) {
+	collectRefined(*(kv.second), scheme, depth + 1, result);
+      }
+    }
+  }
+
+  void SpecializationTable::getSpecializations(Function* f, ArrayRef<Value*> scheme,
 					       std::vector<const Specialization*>& result) const
   {
     const Specialization* current = this->getSpecialization(f);
-    for (std::vector<Specialization*>::const_iterator i =
-        current->children.begin(), e = current->children.end(); i != e; ++i) {
-      if (Specialization::refines((*i)->args, scheme)) {
-        result.push_back(*i);
-      }
+    const size_t first = result.size();
+    collectRefined(current->refined, scheme, 0, result);
+    // the trie does not preserve the order in which the
+    // specializations were added.
+    std::sort(result.begin() + first, result.end(),
+	      [](const Specialization* a, const Specialization* b) {
+		return a->index < b->index;
+	      });
+  }
+
+  const Specialization*
+  SpecializationTable::findSpecialization(Function* f, ArrayRef<Value*> scheme) const {
+    const Specialization* current = this->getSpecialization(f);
+    auto it = current->exact.find(scheme);
+    if (it == current->exact.end()) {
+      return nullptr;
     }
+    return it->second;
   }
 
-  bool SpecializationTable::addSpecialization(Function* parent, SpecScheme scheme,
+  bool SpecializationTable::addSpecialization(Function* parent, ArrayRef<Value*> scheme,
 					      Function* specialization, bool record) {
     assert(parent != NULL);
     assert(specialization != NULL);
@@ -163,32 +211,45 @@ namespace previrt
     Specialization* spec = new Specialization();
     spec->handle = specialization;
     spec->parent = parentSpec;
+    spec->depth = parentSpec->depth + 1;
     std::copy(scheme.begin(), scheme.end(), std::back_inserter(spec->args));
     this->specialized[specialization] = spec;
 
     //.GetOrCreateValue(specialization->getName(), spec);
+    spec->index = parentSpec->children.size();
     parentSpec->children.push_back(spec);
 
-#if RECORD_IN_METADATA
-    // Add the meta-data
-    if (record) {
-      NamedMDNode* md = this->module->getOrInsertNamedMetadata(
-          "previrt::specializations");
-
-      const unsigned int arg_count = parent->getArgumentList().size();
-      Value** vals = new Value*[2 + arg_count];
-      vals[0] = MDString::get(parent->getContext(), parent->getName());
-      vals[1] = MDString::get(parent->getContext(), specialization->getName());
-      for (unsigned int i = 0; i < parent->getArgumentList().size(); ++i) {
-        vals[i+2] = scheme[i];
+    // -- index the new child. The keys point to spec->args which
+    //    lives as long as the table.
+    parentSpec->exact.insert({ArrayRef<Value*>(spec->args), spec});
+    SchemeTrie* node = &parentSpec->refined;
+    for (Value* v: spec->args) {
+      std::unique_ptr<SchemeTrie>& child = node->next[v];
+      if (!child) {
+	child.reset(new SchemeTrie());
       }
+      node = child.get();
+    }
+    node->leaves.push_back(spec);
 
-      ArrayRef<Value*> ar_vals(vals, vals+2+arg_count);
-      MDNode* nde = MDNode::get(this->module->getContext(), ar_vals);
-
-      md->addOperand(nde);
+    // -- Record the specialization so that the next runs on the
+    //    module start with it.
+    if (record) {
+      LLVMContext& ctx = this->module->getContext();
+      NamedMDNode* md = this->module->getOrInsertNamedMetadata(spec_table_md);
+      std::vector<Metadata*> vals;
+      vals.reserve(2 + scheme.size());
+      vals.push_back(ValueAsMetadata::get(parent));
+      vals.push_back(ValueAsMetadata::get(specialization));
+      for (Value* v: scheme) {
+        if (v) {
+          vals.push_back(ValueAsMetadata::get(v));
+        } else {
+          vals.push_back(MDString::get(ctx, "?"));
+        }
+      }
+      md->addOperand(MDNode::get(ctx, vals));
     }
-#endif /* RECORD_IN_METADATA */
 
     return true;
   }
@@ -205,6 +266,14 @@ namespace previrt
     return itr->second;
   }
 
+  const Specialization* SpecializationTable::lookupSpecialization(const Function* f) const {
+    SpecTable::const_iterator itr = this->specialized.find(const_cast<Function*>(f));
+    if (itr == this->specialized.end()) {
+      return NULL;
+    }
+    return itr->second;
+  }
+
   const Specialization* SpecializationTable::getPrincipalSpecialization(Function* f) const {
     const Specialization* spec = this->getSpecialization(f);
     while (spec->parent != NULL) {
@@ -41,10 +41,15 @@
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringExtras.h"
 
 #include "PrevirtTypes.h"
 #include "Specializer.h"
@@ -53,6 +58,20 @@
 
 using namespace llvm;
 
+static cl::opt<bool>
+HashedNames("Pspec-hashed-names",
+	    cl::init(false),
+	    cl::desc("Name specialized functions by a hash of their arguments "
+		     "and record the arguments in metadata"));
+
+// Metadata attached to specialized functions:
+//   !{principal name, arg_0, ..., arg_n}
+// where arg_i is either "?" or the specialized argument.
+static const char* const spec_md = "occam.spec";
+static const StringRef spec_prefix = "__occam_spec.";
+// Attached to the original call left behind a guard
+static const char* const fallback_md = "occam.fallback";
+
 namespace previrt
 {
   std::string specializeName(Function* f, std::vector<std::string>& args) {
@@ -61,6 +80,12 @@ namespace previrt
     args.clear();
     std::string fn = f->getName().str();
 
+    std::string principal;
+    if (f->getMetadata(spec_md) &&
+	getSpecializationInfo(*f, principal, args)) {
+      return spec_prefix.str() + principal;
+    }
+
     int idx = fn.find('(');
     if (idx != -1 && fn[fn.length()-1] == ')') {
       std::string base = fn.substr(0, idx);
@@ -100,6 +125,38 @@ namespace previrt
     }
   }
 
+  bool getSpecializationInfo(const Function& f, std::string& principal,
+			     std::vector<std::string>& args) {
+    args.clear();
+    if (MDNode* md = f.getMetadata(spec_md)) {
+      if (md->getNumOperands() == 0) return false;
+      for (unsigned i = 0, e = md->getNumOperands(); i < e; ++i) {
+	MDString* str = dyn_cast_or_null<MDString>(md->getOperand(i));
+	if (!str) {
+	  args.clear();
+	  return false;
+	}
+	if (i == 0) {
+	  principal = str->getString().str();
+	} else {
+	  args.push_back(str->getString().str());
+	}
+      }
+      return true;
+    }
+
+    // -- named without -Pspec-hashed-names: the arguments are in the name
+    StringRef name = f.getName();
+    if (!name.startswith(spec_prefix) || !name.endswith(")")) {
+      return false;
+    }
+    std::vector<std::string> nameArgs;
+    std::string base = specializeName(const_cast<Function*>(&f), nameArgs);
+    principal = StringRef(base).drop_front(spec_prefix.size()).str();
+    args.swap(nameArgs);
+    return true;
+  }
+
   Function* specializeFunction(Function *f, const std::vector<Value*>& args) {
     assert(!f->isDeclaration());
 
@@ -133,6 +190,7 @@ namespace previrt
     }
     assert (i == f->arg_size());
 
+    const std::string prefix = baseName;
     baseName += "(";
     for (std::vector<std::string>::const_iterator it = argNames.begin(), be = argNames.begin(),
 	   en = argNames.end(); it != en; ++it) {
@@ -141,14 +199,38 @@ namespace previrt
     }
     baseName += ")";
 
-    Function *result = f->getParent()->getFunction(baseName);
+    std::string name = baseName;
+    if (HashedNames) {
+      // __occam_spec.<principal>.<hash of the full name>
+      MD5 hash;
+      MD5::MD5Result digest;
+      hash.update(baseName);
+      hash.final(digest);
+      name = prefix + "." + utohexstr(digest.low(), true);
+    }
+
+    Function *result = f->getParent()->getFunction(name);
     // If specialized function already exists, no reason
     // to create another one. In fact, can cause the process
     // to diverge. 
     if (!result) {
       ClonedCodeInfo info;
       result = llvm::CloneFunction(f, vmap, &info);
-      result->setName(baseName);
+      result->setName(name);
+      // CloneFunction copied the key of f (if it is a specialization)
+      // so it is replaced with the key of the clone, or removed if
+      // the arguments are spelled out in the name.
+      if (HashedNames) {
+	LLVMContext& ctx = f->getContext();
+	std::vector<Metadata*> ops;
+	ops.push_back(MDString::get(ctx, StringRef(prefix).drop_front(spec_prefix.size())));
+	for (auto const& a: argNames) {
+	  ops.push_back(MDString::get(ctx, a));
+	}
+	result->setMetadata(spec_md, MDNode::get(ctx, ops));
+      } else {
+	result->setMetadata(spec_md, nullptr);
+      }
     }
     return result;
   }
@@ -203,6 +285,43 @@ namespace previrt
     return newInst;
   }
 
+  void guardCallSite(Instruction* I, Instruction* newInst,
+		     const std::vector<std::pair<unsigned, Constant*>>& guards) {
+    CallInst* ci = cast<CallInst>(I);
+    CallInst* nci = cast<CallInst>(newInst);
+    
+    // -- the guard: the arguments have the values the clone assumes
+    IRBuilder<> builder(ci);
+    Value* cond = nullptr;
+    for (auto const& g: guards) {
+      Value* eq = builder.CreateICmpEQ(ci->getArgOperand(g.first), g.second);
+      cond = (cond ? builder.CreateAnd(cond, eq) : eq);
+    }
+    assert(cond);
+
+    TerminatorInst *thenTerm, *elseTerm;
+    SplitBlockAndInsertIfThenElse(cond, ci, &thenTerm, &elseTerm);
+    BasicBlock* tail = ci->getParent();
+    nci->insertBefore(thenTerm);
+    ci->moveBefore(elseTerm);
+    // A tail call cannot be followed by a phi node
+    nci->setTailCallKind(CallInst::TCK_None);
+    ci->setTailCallKind(CallInst::TCK_None);
+    // The original call is the fallback: do not guard it again.
+    ci->setMetadata(fallback_md, MDNode::get(ci->getContext(), None));
+
+    if (!ci->getType()->isVoidTy()) {
+      PHINode* phi = PHINode::Create(ci->getType(), 2, "", &tail->front());
+      ci->replaceAllUsesWith(phi);
+      phi->addIncoming(nci, nci->getParent());
+      phi->addIncoming(ci, ci->getParent());
+    }
+  }
+
+  bool isGuardFallback(const Instruction* cs) {
+    return cs->getMetadata(fallback_md) != nullptr;
+  }
+
   GlobalVariable* materializeStringLiteral(llvm::Module& m, const char* data) {
     Constant* ary = llvm::ConstantDataArray::getString(m.getContext(), data, true);
     GlobalVariable* gv = new GlobalVariable(m, ary->getType(), true,
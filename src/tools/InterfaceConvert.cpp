@@ -0,0 +1,97 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+/**
+ * occam-iface-convert: convert interface and rewrite files between
+ * the protobuf and the flat formats.
+ *
+ *    occam-iface-convert [-flat] [-transform] -o <out> <in>
+ *
+ * <in> can be in either format. <out> is in the flat format with
+ * -flat and in the protobuf format otherwise. -transform is for
+ * rewrite (.rw) files.
+ **/
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "PrevirtualizeInterfaces.h"
+#include "FlatInterface.h"
+
+#include <string>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+InputFile(cl::Positional, cl::Required,
+	  cl::desc("<input file>"));
+
+static cl::opt<std::string>
+OutputFile("o", cl::Required,
+	   cl::desc("output file"),
+	   cl::value_desc("filename"));
+
+static cl::opt<bool>
+Flat("flat",
+     cl::desc("write the flat format (protobuf otherwise)"));
+
+static cl::opt<bool>
+Transform("transform",
+	  cl::desc("convert a rewrite file"));
+
+int main(int argc, char** argv) {
+  cl::ParseCommandLineOptions(argc, argv, "OCCAM interface conversion\n");
+
+  bool success;
+  if (Transform) {
+    previrt::ComponentInterfaceTransform rw;
+    if (!rw.readTransformFromFile(InputFile)) {
+      errs() << "occam-iface-convert: failed to read rewrites " << InputFile << "\n";
+      return 1;
+    }
+    success = previrt::writeTransformFile(rw, OutputFile, Flat);
+  } else {
+    previrt::ComponentInterface ci;
+    if (!ci.readFromFile(InputFile)) {
+      errs() << "occam-iface-convert: failed to read interface " << InputFile << "\n";
+      return 1;
+    }
+    success = previrt::writeInterfaceFile(ci, OutputFile, Flat);
+  }
+  if (!success) {
+    errs() << "occam-iface-convert: failed to write " << OutputFile << "\n";
+    return 1;
+  }
+  return 0;
+}
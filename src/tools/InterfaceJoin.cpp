@@ -0,0 +1,101 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/**
+ * occam-iface-join: merge interface files.
+ *
+ *    occam-iface-join -o <out> <iface> <iface>*
+ *
+ * The calls, references and facts of all the interfaces are merged into the
+ * first one and written to <out>. The counts of identical calls are
+ * added up. Prints "changed" if a call or reference that was not in
+ * the first interface was added, and "unchanged" otherwise. <out> is
+ * in the flat format with -Pflat-interfaces. With -Pinterface-widen=K,
+ * the calls to a function that has more than K distinct calls are
+ * widened (see ComponentInterface::widen).
+ **/
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "PrevirtualizeInterfaces.h"
+#include "FlatInterface.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<std::string>
+InputFiles(cl::Positional, cl::OneOrMore,
+	   cl::desc("<input interfaces>"));
+
+static cl::opt<std::string>
+OutputFile("o", cl::Required,
+	   cl::desc("output interface"),
+	   cl::value_desc("filename"));
+
+int main(int argc, char** argv) {
+  cl::ParseCommandLineOptions(argc, argv, "OCCAM interface join\n");
+
+  std::vector<std::unique_ptr<previrt::ComponentInterface>> ifaces;
+  for (const std::string& f : InputFiles) {
+    std::unique_ptr<previrt::ComponentInterface> ci(new previrt::ComponentInterface());
+    if (!ci->readFromFile(f)) {
+      errs() << "occam-iface-join: failed to read interface " << f << "\n";
+      return 1;
+    }
+    ifaces.push_back(std::move(ci));
+  }
+
+  std::vector<const previrt::ComponentInterface*> others;
+  for (unsigned i = 1, e = ifaces.size(); i < e; ++i) {
+    others.push_back(ifaces[i].get());
+  }
+  bool changed = ifaces[0]->join(others);
+
+  previrt::WidenStats widened;
+  if (ifaces[0]->widen(widened)) {
+    errs() << "occam-iface-join: ";
+    widened.print(errs());
+  }
+
+  if (!previrt::writeInterfaceFile(*ifaces[0], OutputFile)) {
+    errs() << "occam-iface-join: failed to write interface " << OutputFile << "\n";
+    return 1;
+  }
+
+  outs() << (changed ? "changed" : "unchanged") << "\n";
+  return 0;
+}
@@ -0,0 +1,483 @@
+//
+// OCCAM
+//
+// Copyright (c) 2020, SRI International
+//
+//  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of SRI International nor the names of its contributors may
+//   be used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/**
+ * occam-driver: a long-lived replacement for the
+ *
+ *    opt -load libSeaDsa -load libDSA -load libprevirt <in> -o <out> ...
+ *
+ * processes that razor spawns for every OCCAM pass.
+ *
+ * Modules are parsed once and kept in memory across requests. A
+ * module produced by a request is only written back to disk when
+ * razor asks for it (checkpoints) or when a tool outside of the
+ * driver needs the file.
+ *
+ * Requests are read from stdin. A request is a sequence of lines
+ * terminated by an empty line. The first line is the command and
+ * each of the following lines is one operand:
+ *
+ *   load <library>                  load a plugin (like opt -load)
+ *   run <in> <out> <log> <arg>*     run the passes described by the
+ *                                   opt-like arguments <arg>* on <in>
+ *                                   and keep the result in memory as
+ *                                   <out>. The stderr of the passes is
+ *                                   appended to <log> (if not "-").
+ *   sync <file>                     write <file> to disk if dirty
+ *   sync-all                        write all dirty modules to disk
+ *   drop <file>                     forget the module for <file>
+ *   quit
+ *
+ * Each request is answered with exactly one line on stdout:
+ *
+ *   ok [progress|no-progress]
+ *   error <message>
+ **/
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LegacyPassNameParser.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/LinkAllIR.h"
+#include "llvm/LinkAllPasses.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace llvm;
+
+// The passes requested by a "run" command (same as in opt).
+static cl::list<const PassInfo*, bool, PassNameParser>
+PassList(cl::desc("Optimizations available:"));
+
+static cl::opt<unsigned>
+MaxCleanModules("max-clean-modules",
+		cl::init(64),
+		cl::desc("Maximum number of unmodified modules kept in memory"));
+
+namespace previrt {
+
+  /*
+   * LLVM 5 does not clear the storage of a cl::list when its
+   * occurrences are reset, so the inputs of one request would leak
+   * into the next one. These are the list options registered by the
+   * OCCAM passes; all of them are cl::list<std::string>.
+   */
+  static const char* ListOptions[] = {
+    "Pinterface-entry",
+    "Pinternalize-input",
+    "Pspecialize-input",
+    "Prewrite-input",
+    "Pfacts-input",
+    "Pconfig-prime-input-arg",
+    "Pcallgraph-roots"
+  };
+
+  static void resetOptions() {
+    cl::ResetAllOptionOccurrences();
+    PassList.clear();
+    StringMap<cl::Option*>& opts = cl::getRegisteredOptions();
+    for (const char* name : ListOptions) {
+      auto it = opts.find(name);
+      if (it != opts.end()) {
+	static_cast<cl::list<std::string>*>(it->second)->clear();
+      }
+    }
+  }
+
+  /* A module in memory together with its own context */
+  struct ModuleEntry {
+    std::unique_ptr<LLVMContext> context;
+    std::unique_ptr<Module> module;
+    // true if the module has not been written to disk yet
+    bool dirty;
+    // file status when the module was read/written. Used to detect
+    // that some other tool has overwritten the file.
+    sys::TimePoint<> mtime;
+    uint64_t size;
+  };
+
+  class ModuleCache {
+    StringMap<std::unique_ptr<ModuleEntry>> m_entries;
+    // the options are reset for every request so we keep our own copy
+    const unsigned m_max_clean;
+    // recently used keys (most recent at the front)
+    std::list<std::string> m_lru;
+
+    void touch(StringRef key) {
+      m_lru.remove(key.str());
+      m_lru.push_front(key.str());
+    }
+
+    static bool getStatus(StringRef file, sys::TimePoint<>& mtime, uint64_t& size) {
+      sys::fs::file_status st;
+      if (sys::fs::status(file, st)) {
+	return false;
+      }
+      mtime = st.getLastModificationTime();
+      size = st.getSize();
+      return true;
+    }
+
+    // Evict unmodified modules if there are too many of them.
+    void evict() {
+      unsigned clean = 0;
+      for (auto &kv: m_entries) {
+	if (!kv.second->dirty) clean++;
+      }
+      for (auto it = m_lru.rbegin(); clean > m_max_clean && it != m_lru.rend(); ) {
+	auto entry = m_entries.find(*it);
+	if (entry != m_entries.end() && !entry->second->dirty) {
+	  m_entries.erase(entry);
+	  it = std::list<std::string>::reverse_iterator(m_lru.erase(std::next(it).base()));
+	  clean--;
+	} else {
+	  ++it;
+	}
+      }
+    }
+
+  public:
+
+    ModuleCache(unsigned max_clean): m_max_clean(max_clean) {}
+
+    // Return the module for file (reading it from disk if needed)
+    ModuleEntry* get(StringRef file, std::string& error) {
+      auto it = m_entries.find(file);
+      if (it != m_entries.end()) {
+	ModuleEntry* entry = it->second.get();
+	sys::TimePoint<> mtime;
+	uint64_t size;
+	if (entry->dirty ||
+	    (getStatus(file, mtime, size) && mtime == entry->mtime && size == entry->size)) {
+	  touch(file);
+	  return entry;
+	}
+	// the file was overwritten by another tool
+	m_entries.erase(it);
+      }
+
+      std::unique_ptr<ModuleEntry> entry = llvm::make_unique<ModuleEntry>();
+      entry->context = llvm::make_unique<LLVMContext>();
+      SMDiagnostic diag;
+      entry->module = parseIRFile(file, diag, *entry->context);
+      if (!entry->module) {
+	error = "cannot read " + file.str() + ": " + diag.getMessage().str();
+	return nullptr;
+      }
+      entry->dirty = false;
+      getStatus(file, entry->mtime, entry->size);
+      ModuleEntry* res = entry.get();
+      m_entries[file] = std::move(entry);
+      touch(file);
+      evict();
+      return res;
+    }
+
+    // Store the module of from as the (dirty) contents of to
+    void rename(StringRef from, StringRef to) {
+      auto it = m_entries.find(from);
+      assert(it != m_entries.end());
+      std::unique_ptr<ModuleEntry> entry = std::move(it->second);
+      m_entries.erase(it);
+      m_lru.remove(from.str());
+      entry->dirty = true;
+      m_entries[to] = std::move(entry);
+      touch(to);
+    }
+
+    void markDirty(StringRef file) {
+      auto it = m_entries.find(file);
+      if (it != m_entries.end()) {
+	it->second->dirty = true;
+      }
+    }
+
+    void drop(StringRef file) {
+      m_entries.erase(file);
+      m_lru.remove(file.str());
+    }
+
+    bool sync(StringRef file, std::string& error) {
+      auto it = m_entries.find(file);
+      if (it == m_entries.end() || !it->second->dirty) {
+	return true;
+      }
+      ModuleEntry* entry = it->second.get();
+      std::error_code EC;
+      raw_fd_ostream out(file, EC, sys::fs::F_None);
+      if (EC) {
+	error = "cannot write " + file.str() + ": " + EC.message();
+	return false;
+      }
+      WriteBitcodeToFile(entry->module.get(), out);
+      out.close();
+      entry->dirty = false;
+      getStatus(file, entry->mtime, entry->size);
+      return true;
+    }
+
+    bool syncAll(std::string& error) {
+      for (auto &kv: m_entries) {
+	if (!sync(kv.first(), error)) {
+	  return false;
+	}
+      }
+      evict();
+      return true;
+    }
+  };
+
+  /*
+   * Redirect stderr (fd 2) to a temporary file while the passes run
+   * so that we can search their output for "...progress..." (as
+   * razor does with the output of opt) and copy it to the log.
+   */
+  class StderrCapture {
+    int m_saved;
+    FILE* m_tmp;
+  public:
+    StderrCapture(): m_saved(-1), m_tmp(tmpfile()) {
+      if (!m_tmp) return;
+      errs().flush();
+      fflush(stderr);
+      m_saved = dup(2);
+      dup2(fileno(m_tmp), 2);
+    }
+
+    std::string release() {
+      std::string res;
+      if (!m_tmp || m_saved < 0) return res;
+      errs().flush();
+      fflush(stderr);
+      dup2(m_saved, 2);
+      close(m_saved);
+      m_saved = -1;
+      rewind(m_tmp);
+      char buf[4096];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), m_tmp)) > 0) {
+	res.append(buf, n);
+      }
+      fclose(m_tmp);
+      m_tmp = nullptr;
+      return res;
+    }
+
+    ~StderrCapture() { release(); }
+  };
+
+  class Driver {
+    ModuleCache m_cache;
+
+    bool runPasses(const std::vector<std::string>& ops, bool& progress,
+		   std::string& error) {
+      if (ops.size() < 3) {
+	error = "run expects <in> <out> <log>";
+	return false;
+      }
+      const std::string& in = ops[0];
+      const std::string& out = ops[1];
+      const std::string& log = ops[2];
+
+      ModuleEntry* entry = m_cache.get(in, error);
+      if (!entry) {
+	return false;
+      }
+
+      resetOptions();
+      std::vector<const char*> argv;
+      argv.push_back("occam-driver");
+      for (unsigned i = 3; i < ops.size(); ++i) {
+	argv.push_back(ops[i].c_str());
+      }
+      std::string parseErrors;
+      raw_string_ostream parseOut(parseErrors);
+      if (!cl::ParseCommandLineOptions(argv.size(), &argv[0], "", &parseOut)) {
+	error = parseOut.str();
+	return false;
+      }
+
+      bool modified;
+      std::string output;
+      {
+	StderrCapture capture;
+	legacy::PassManager PM;
+	for (const PassInfo* PI: PassList) {
+	  if (!PI->getNormalCtor()) {
+	    error = "cannot create pass " + PI->getPassArgument().str();
+	    return false;
+	  }
+	  PM.add(PI->getNormalCtor()());
+	}
+	PM.add(createVerifierPass());
+	modified = PM.run(*entry->module);
+	output = capture.release();
+      }
+
+      errs() << output;
+      if (log != "-") {
+	std::ofstream logfile(log, std::ios::app);
+	logfile << output;
+      }
+      progress = (output.find("...progress...") != std::string::npos);
+
+      if (out == "/dev/null") {
+	// the result is not needed. If the passes changed the module
+	// then the in-memory copy does not correspond to the input
+	// file anymore.
+	if (modified) {
+	  m_cache.drop(in);
+	}
+      } else if (out != in) {
+	m_cache.rename(in, out);
+      } else {
+	m_cache.markDirty(out);
+      }
+      return true;
+    }
+
+  public:
+
+    Driver(unsigned max_clean): m_cache(max_clean) {}
+
+    // Process one request. Return false if the driver must stop.
+    bool process(const std::vector<std::string>& req) {
+      const std::string& cmd = req[0];
+      std::vector<std::string> ops(req.begin() + 1, req.end());
+      std::string error;
+      bool ok = true;
+      bool progress = false;
+      bool report_progress = false;
+
+      if (cmd == "quit") {
+	return false;
+      } else if (cmd == "load") {
+	for (const std::string& lib: ops) {
+	  if (sys::DynamicLibrary::LoadLibraryPermanently(lib.c_str(), &error)) {
+	    ok = false;
+	    break;
+	  }
+	}
+      } else if (cmd == "run") {
+	ok = runPasses(ops, progress, error);
+	report_progress = true;
+      } else if (cmd == "sync") {
+	for (const std::string& file: ops) {
+	  if (!(ok = m_cache.sync(file, error))) break;
+	}
+      } else if (cmd == "sync-all") {
+	ok = m_cache.syncAll(error);
+      } else if (cmd == "drop") {
+	for (const std::string& file: ops) {
+	  m_cache.drop(file);
+	}
+      } else {
+	ok = false;
+	error = "unknown command " + cmd;
+      }
+
+      if (ok) {
+	std::cout << "ok";
+	if (report_progress) {
+	  std::cout << (progress ? " progress" : " no-progress");
+	}
+	std::cout << std::endl;
+      } else {
+	// keep the answer in one line
+	std::replace(error.begin(), error.end(), '\n', ' ');
+	std::cout << "error " << error << std::endl;
+      }
+      return true;
+    }
+  };
+} // end namespace previrt
+
+int main(int argc, char** argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;
+
+  PassRegistry &Registry = *PassRegistry::getPassRegistry();
+  initializeCore(Registry);
+  initializeScalarOpts(Registry);
+  initializeIPO(Registry);
+  initializeAnalysis(Registry);
+  initializeTransformUtils(Registry);
+  initializeInstCombine(Registry);
+  initializeInstrumentation(Registry);
+  initializeTarget(Registry);
+
+  cl::ParseCommandLineOptions(argc, argv, "OCCAM persistent pass driver\n");
+
+  previrt::Driver driver(MaxCleanModules);
+  std::vector<std::string> request;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    if (!line.empty()) {
+      request.push_back(line);
+      continue;
+    }
+    if (request.empty()) {
+      continue;
+    }
+    if (!driver.process(request)) {
+      break;
+    }
+    request.clear();
+  }
+  return 0;
+}
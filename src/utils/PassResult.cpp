@@ -0,0 +1,55 @@
+#include "utils/PassResult.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+static llvm::cl::opt<std::string>
+ResultOutput("Presult-output",
+	     llvm::cl::desc("Append the results of the OCCAM passes to this file"),
+	     llvm::cl::init(""),
+	     llvm::cl::Hidden);
+
+namespace previrt {
+namespace utils {
+
+  PassResult::PassResult(llvm::StringRef pass, const llvm::Module& M)
+    : m_pass(pass) {
+    if (ResultOutput.empty()) return;
+    for (const llvm::Function& F : M) {
+      if (!F.isDeclaration()) {
+	m_functions.insert(F.getName());
+      }
+    }
+  }
+
+  void PassResult::report(const llvm::Module& M, bool changed) const {
+    if (ResultOutput.empty()) return;
+    
+    unsigned added = 0, kept = 0;
+    for (const llvm::Function& F : M) {
+      if (F.isDeclaration()) continue;
+      if (m_functions.count(F.getName())) {
+	++kept;
+      } else {
+	++added;
+      }
+    }
+    unsigned removed = m_functions.size() - kept;
+
+    std::error_code ec;
+    llvm::raw_fd_ostream out(ResultOutput, ec, llvm::sys::fs::F_Append);
+    if (ec) {
+      llvm::errs() << "cannot open " << ResultOutput << ": " << ec.message() << "\n";
+      return;
+    }
+    out << "{\"pass\":\"" << m_pass << "\""
+	<< ",\"changed\":" << (changed ? "true" : "false")
+	<< ",\"added\":" << added
+	<< ",\"removed\":" << removed << "}\n";
+  }
+  
+}
+}
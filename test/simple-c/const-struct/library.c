@@ -0,0 +1,10 @@
+#include "library.h"
+
+/* keeps the address of the last point */
+const struct point * last;
+
+int norm(const struct point * p){
+  last = p;
+  return p->x * p->x + p->y * p->y;
+}
+
@@ -0,0 +1,17 @@
+#include "library.h"
+
+#include <stdio.h>
+
+/* exported: the library keeps its address */
+const struct point unit = { 1, 1 };
+
+/* local and its address is never compared: copied into the library */
+static const struct point origin = { 3, 4 };
+
+int main(int argc, char* argv[]){
+  int r1 = norm(&origin);
+  int r2 = norm(&unit);
+
+  printf("%d %d\n", r1, r2);
+  return 0;
+}
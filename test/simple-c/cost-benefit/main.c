@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int nd_int(){
+  srand(time(NULL));
+  return rand() ;
+}
+
+/* A constant mode decides the switch and removes the other cases. */
+int compute(int mode, int x){
+  int r = x;
+  switch(mode){
+  case 0:
+    r = r * nd_int() + 3;
+    r = r ^ nd_int();
+    r = r - nd_int() * 5;
+    break;
+  case 1:
+    r = r + 1;
+    break;
+  case 2:
+    r = r * 7 - nd_int();
+    r = r | nd_int();
+    r = r + nd_int() * 11;
+    break;
+  default:
+    r = r / (nd_int() | 1);
+    r = r % (nd_int() | 1);
+    r = r + nd_int();
+  }
+  return r;
+}
+
+/* A constant tag folds nothing: it is only printed. */
+int report(int tag, int x){
+  int i, sum = 0;
+  for (i = 0; i < x; i++) {
+    sum += nd_int() % (i + 1);
+  }
+  printf("report %d: %d\n", tag, sum);
+  return sum;
+}
+
+int main(int argc, char* argv[]){
+
+  int x = nd_int();
+  int y = nd_int();
+
+  int r1 = compute(1, x);
+  int r2 = compute(y, x);
+  int r3 = report(7, x);
+  int r4 = report(y, x);
+
+  printf("%d %d %d %d\n", r1, r2, r3, r4);
+  return 0;
+}
@@ -0,0 +1,9 @@
+#include "library.h"
+
+/* Always false: the callers in other modules can fold it. */
+int feature_enabled(void){
+  return 0;
+}
+
+const int lib_version = 42;
+
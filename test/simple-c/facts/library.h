@@ -0,0 +1,3 @@
+extern int feature_enabled(void);
+extern const int lib_version;
+
@@ -0,0 +1,11 @@
+#include "library.h"
+
+#include <stdio.h>
+
+int main(int argc, char* argv[]){
+  if (feature_enabled()) {
+    printf("the feature is enabled\n");
+  }
+  printf("library version %d\n", lib_version);
+  return 0;
+}
@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+
+# Specialize a copy again, with and without -Pspec-hashed-names. The
+# new copy must be a copy of f (not of the copy) on both arguments,
+# which is read back from the name or from the !occam.spec metadata.
+
+LIBEXT='so'
+
+unamestr=`uname`
+if [[ "$unamestr" == 'Darwin' ]]; then
+   LIBEXT='dylib'
+fi
+
+make
+
+OPT=${LLVM_HOME}/bin/opt
+LIBS="-load=${OCCAM_HOME}/lib/libSeaDsa.${LIBEXT} -load=${OCCAM_HOME}/lib/libDSA.${LIBEXT} -load=${OCCAM_HOME}/lib/libprevirt.${LIBEXT}"
+
+${OPT} ${LIBS} clone.bc -S -o clone.out.ll \
+       -Ppeval -Ppeval-policy=aggressive
+${OPT} ${LIBS} clone-hashed.bc -S -o clone-hashed.out.ll \
+       -Ppeval -Ppeval-policy=aggressive -Pspec-hashed-names
+
+exit 0
@@ -0,0 +1,23 @@
+; The same copy of f, named by a hash: its principal and arguments
+; are only in its !occam.spec metadata.
+
+define internal i32 @f(i32 %mode, i32 %x) {
+entry:
+  %r = mul i32 %mode, %x
+  ret i32 %r
+}
+
+define internal i32 @__occam_spec.f.0123456789ABCDEF(i32 %x) !occam.spec !0 {
+entry:
+  ret i32 %x
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %r = call i32 @__occam_spec.f.0123456789ABCDEF(i32 7)
+  %s = call i32 @f(i32 %argc, i32 %argc)
+  %t = add i32 %r, %s
+  ret i32 %t
+}
+
+!0 = !{!"f", !"0x1", !"?"}
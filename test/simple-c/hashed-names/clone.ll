@@ -0,0 +1,21 @@
+; A copy of f on its first argument, named by its arguments, and a
+; call to it whose second argument is now known.
+
+define internal i32 @f(i32 %mode, i32 %x) {
+entry:
+  %r = mul i32 %mode, %x
+  ret i32 %r
+}
+
+define internal i32 @"__occam_spec.f(0x1,?)"(i32 %x) {
+entry:
+  ret i32 %x
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %r = call i32 @"__occam_spec.f(0x1,?)"(i32 7)
+  %s = call i32 @f(i32 %argc, i32 %argc)
+  %t = add i32 %r, %s
+  ret i32 %t
+}
@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+
+# Convert the interfaces of the program and of its library from
+# protobuf to the flat format and back. The result must describe the
+# same calls, facts and references as the original.
+
+LIBRARY='library'
+LIBEXT='so'
+
+unamestr=`uname`
+if [[ "$unamestr" == 'Linux' ]]; then
+   LIBRARY='library.so'
+elif [[ "$unamestr" == 'Darwin' ]]; then
+   LIBRARY='library.dylib'
+   LIBEXT='dylib'
+fi
+
+#make the bitcode
+CC=gclang make
+get-bc main
+get-bc ${LIBRARY}
+
+OPT=${LLVM_HOME}/bin/opt
+LIBS="-load=${OCCAM_HOME}/lib/libSeaDsa.${LIBEXT} -load=${OCCAM_HOME}/lib/libDSA.${LIBEXT} -load=${OCCAM_HOME}/lib/libprevirt.${LIBEXT}"
+CONVERT=${OCCAM_HOME}/bin/occam-iface-convert
+
+# One line per call, fact and reference, sorted: the order of the
+# entries in a file is not significant.
+dump() {
+    python - "$1" <<PYEOF
+import sys
+from google.protobuf import text_format
+from razor import interface
+iface = interface.parseInterface(sys.argv[1])
+lines = []
+for field in ['calls', 'definitions', 'globals']:
+    for x in getattr(iface, field):
+        lines.append(field + ' ' + text_format.MessageToString(x, as_one_line=True))
+for r in iface.references:
+    lines.append('references ' + r)
+for l in sorted(lines):
+    print(l)
+PYEOF
+}
+
+for m in main ${LIBRARY}; do
+    ${OPT} ${LIBS} ${m}.bc -o /dev/null -Pinterface -Pinterface-output ${m}.iface
+    ${CONVERT} -flat -o ${m}.flat ${m}.iface
+    ${CONVERT} -o ${m}.roundtrip.iface ${m}.flat
+    dump ${m}.iface > ${m}.txt
+    dump ${m}.roundtrip.iface > ${m}.roundtrip.txt
+done
+
+exit 0
@@ -0,0 +1,19 @@
+#include "library.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int libcall_int(int x, int y){ return x + y; }
+
+int libcall_float(int x, float f){ return x + (int) f; }
+
+int libcall_double(int x, double d){ return x + (int) d; }
+
+int libcall_string(int x, const char* s){ return x + strlen(s); }
+
+int libcall_null_pointer(int x, void * p){ return p == NULL ? x : 0; }
+
+int libcall_global_pointer(int x, void * p){ return p == NULL ? 0 : x; }
+
+int libcall_struct(const struct point * p){ return p->x + p->y; }
+
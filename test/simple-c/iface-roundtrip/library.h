@@ -0,0 +1,16 @@
+struct point { int x; int y; };
+
+extern int libcall_int(int, int);
+
+extern int libcall_float(int, float);
+
+extern int libcall_double(int, double);
+
+extern int libcall_string(int, const char*);
+
+extern int libcall_null_pointer(int, void *);
+
+extern int libcall_global_pointer(int, void *);
+
+extern int libcall_struct(const struct point *);
+
@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "library.h"
+
+int global = 666;
+static const struct point origin = { 1, 2 };
+
+/* facts: a constant return value and a constant global */
+const int main_flags = 7;
+
+int main_version(void){
+  return 3;
+}
+
+int main(int argc, char* argv[]){
+  int n = atoi(argv[argc - 1]);
+  int retval =
+    libcall_int(1, n) +
+    libcall_int(2, n) +
+    libcall_float(n, 0.5F) +
+    libcall_double(n, 0.75) +
+    libcall_string(5, "Z") +
+    libcall_null_pointer(4, NULL) +
+    libcall_global_pointer(n, &global) +
+    libcall_struct(&origin) +
+    main_version() + main_flags;
+
+  printf("main returning %d\n", retval);
+  return 0;
+}
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+
+# Two workers sync a module that another thread's occam-driver holds
+# in memory, while that thread keeps sending requests to its driver.
+
+#make the bitcode
+CC=gclang make
+get-bc main
+
+rm -f main.*.bc occam-driver.*.log
+
+python - <<PYEOF
+import os
+import threading
+from razor import persistent
+
+MODULES = 100
+persistent.enable(os.getcwd())
+modules = ['main.{0}.bc'.format(i) for i in range(MODULES)]
+synced = []
+errors = []
+
+# this thread's driver holds all the modules in memory
+for m in modules:
+    persistent.previrt('main.bc', m, ['-globaldce'])
+    if os.path.isfile(m):
+        os.unlink(m)
+
+def worker():
+    try:
+        for m in modules:
+            persistent.sync([m])
+            if persistent.holds(m) or not os.path.isfile(m):
+                errors.append('{0} is not on disk after sync'.format(m))
+            else:
+                synced.append(m)
+    except persistent.DriverError as e:
+        errors.append(str(e))
+
+workers = [threading.Thread(target=worker) for i in range(2)]
+for w in workers:
+    w.start()
+# while the owner keeps its driver busy
+for i in range(MODULES):
+    persistent.previrt('main.bc', 'main.busy.bc', ['-globaldce'])
+for w in workers:
+    w.join()
+
+persistent.shutdown()
+for e in errors:
+    print('error: ' + e)
+print('synced {0} of {1}'.format(len(synced), 2 * MODULES))
+PYEOF
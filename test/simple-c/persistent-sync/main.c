@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+static int unused(int x) {
+  return x * 2;
+}
+
+int main(int argc, char* argv[]) {
+  printf("%d arguments\n", argc);
+  return 0;
+}
@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+
+# Run the intra-module passes on main.bc in a single -Ppeval-pipeline
+# and as the sequence of opt invocations that it replaces. Both must
+# produce the same functions.
+
+LIBEXT='so'
+
+unamestr=`uname`
+if [[ "$unamestr" == 'Darwin' ]]; then
+   LIBEXT='dylib'
+fi
+
+#make the bitcode
+CC=gclang make
+get-bc main
+
+OPT=${LLVM_HOME}/bin/opt
+LIBS="-load=${OCCAM_HOME}/lib/libSeaDsa.${LIBEXT} -load=${OCCAM_HOME}/lib/libDSA.${LIBEXT} -load=${OCCAM_HOME}/lib/libprevirt.${LIBEXT}"
+O3="-disable-simplify-libcalls --disable-loop-vectorization --disable-slp-vectorization -O3"
+PEVAL="-Ppeval-policy=aggressive -Ppeval-opt"
+
+# 1. everything in one process
+${OPT} ${LIBS} main.bc -o pipeline.bc -Ppeval-pipeline ${PEVAL}
+
+# 2. -O3, then -Ppeval until it does not change the module, then -O3
+${OPT} main.bc -o separate.bc ${O3}
+specialized=0
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    ${OPT} ${LIBS} separate.bc -o peval.bc -Ppeval ${PEVAL}
+    if cmp -s separate.bc peval.bc; then
+	break
+    fi
+    mv peval.bc separate.bc
+    specialized=1
+done
+if [[ ${specialized} == 1 ]]; then
+    ${OPT} separate.bc -o peval.bc ${O3}
+    mv peval.bc separate.bc
+fi
+
+for bitcode in pipeline separate; do
+    ${LLVM_HOME}/bin/llvm-dis "${bitcode}.bc" &> /dev/null
+    grep '^define' "${bitcode}.ll" | sort > "${bitcode}.defs"
+done
+
+exit 0
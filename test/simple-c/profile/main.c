@@ -0,0 +1,26 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+int scale(int factor, int x){
+  switch(factor){
+  case 2:
+    return x << 1;
+  case 6:
+    return x * 6;
+  case 7:
+    return x * 7;
+  default:
+    printf("unexpected factor %d\n", factor);
+    return x * factor;
+  }
+}
+
+int main(int argc, char* argv[]){
+  /* the profile says that factor is always 2 here */
+  int a = scale(argc, 10);
+  /* and that it is 6 or 7 as often here */
+  int b = scale(argc + 5, 20);
+
+  printf("%d %d\n", a, b);
+  return 0;
+}
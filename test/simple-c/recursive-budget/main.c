@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* n varies across the recursion, k does not. Subtraction keeps the
+   call from being turned into a loop. */
+static int scaled(int n, int k) {
+  if (n <= 0) return 0;
+  return k - scaled(n - 1, k);
+}
+
+int main(int argc, char* argv[]) {
+  int z = atoi(argv[argc - 1]);
+  /* two calls on the same constants share one copy */
+  int a = scaled(5, z);
+  int b = scaled(5, z + 1);
+  /* only the invariant argument is constant: always specialized */
+  int c = scaled(z, 3);
+  printf("%d %d %d\n", a, b, c);
+  return 0;
+}
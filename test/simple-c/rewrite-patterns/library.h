@@ -0,0 +1,2 @@
+extern int libcall(int, int);
+
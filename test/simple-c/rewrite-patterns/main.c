@@ -0,0 +1,18 @@
+#include "library.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+int main(int argc, char* argv[]){
+  /* argc is unknown: no "args" in the manifest */
+  int r1 = libcall(1,2);
+  int r2 = libcall(3,argc);
+  int r3 = libcall(argc,4);
+  int r4 = libcall(3,4);
+  int r5 = libcall(argc,argc);
+
+  printf("%d %d %d %d %d\n", r1,r2,r3,r4,r5);
+  return 0;
+}
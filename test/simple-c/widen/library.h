@@ -0,0 +1,4 @@
+extern int libcall(int, int);
+
+extern int othercall(int, int);
+
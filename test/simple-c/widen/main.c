@@ -0,0 +1,20 @@
+#include "library.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+int main(int argc, char* argv[]){
+  /* four distinct calls: over the limit, uno is widened */
+  int r1 = libcall(1,7);
+  int r2 = libcall(2,7);
+  int r3 = libcall(3,7);
+  int r4 = libcall(4,7);
+  /* two distinct calls: under the limit, kept as they are */
+  int r5 = othercall(1,2);
+  int r6 = othercall(3,4);
+
+  printf("%d %d %d %d %d %d\n", r1,r2,r3,r4,r5,r6);
+  return 0;
+}
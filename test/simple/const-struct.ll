@@ -0,0 +1,20 @@
+; RUN: cd %const_struct && %const_struct/build.sh
+; RUN: %llvm_as < %const_struct/slash/main-final.ll | %llvm_dis | FileCheck %s
+; RUN: %llvm_as < %const_struct/slash/library.so-final.ll | %llvm_dis | FileCheck --check-prefix=LIB %s
+; RUN: LD_LIBRARY_PATH=%const_struct/slash %const_struct/main_slash | FileCheck --check-prefix=OUT %s
+
+; The library refers to the exported global, so it is not internalized.
+; CHECK-NOT: @unit = internal
+; CHECK: @unit = {{.*}}constant %struct.point { i32 1, i32 1 }
+
+; Both calls pass a pointer to a constant struct (P) and are
+; specialized across modules.
+; CHECK-DAG: call {{.*}}@"__occam_spec.norm(P:{{[0-9A-F]+}})"()
+; CHECK-DAG: call {{.*}}@"__occam_spec.norm(P:{{[0-9A-F]+}})"()
+
+; The exported global keeps its address: the library only sees its
+; initializer. The local unnamed_addr global is copied.
+; LIB-DAG: @unit = available_externally {{.*}}constant %struct.point { i32 1, i32 1 }
+; LIB-DAG: @__occam.const.{{.*}} = private unnamed_addr constant %struct.point { i32 3, i32 4 }
+
+; OUT: 25 2
@@ -0,0 +1,141 @@
+; RUN: cd %cost_benefit && %cost_benefit/build.sh
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck %s
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck --check-prefix=LOW %s
+
+; The constant mode of compute folds its switch: the copy is worth it.
+; The constant tag of report folds nothing: no copy.
+; LOW-NOT: "__occam_spec.report
+
+; ModuleID = 'slash/main-final.bc'
+source_filename = "llvm-link"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@.str = private unnamed_addr constant [15 x i8] c"report %d: %d\0A\00", align 1
+@.str.1 = private unnamed_addr constant [13 x i8] c"%d %d %d %d\0A\00", align 1
+
+; Function Attrs: noinline nounwind uwtable
+define internal fastcc i32 @nd_int() unnamed_addr #0 {
+entry:
+  %call = tail call i64 @time(i64* null) #3
+  %conv = trunc i64 %call to i32
+  tail call void @srand(i32 %conv) #3
+  %call1 = tail call i32 @rand() #3
+  ret i32 %call1
+}
+
+; Function Attrs: nounwind
+declare i64 @time(i64*) local_unnamed_addr #1
+
+; Function Attrs: nounwind
+declare void @srand(i32) local_unnamed_addr #1
+
+; Function Attrs: nounwind
+declare i32 @rand() local_unnamed_addr #1
+
+; Function Attrs: noinline nounwind uwtable
+define internal fastcc i32 @compute(i32 %mode, i32 %x) unnamed_addr #0 {
+entry:
+  switch i32 %mode, label %sw.default [
+    i32 0, label %sw.bb
+    i32 1, label %sw.bb5
+    i32 2, label %sw.bb7
+  ]
+
+sw.bb:                                            ; preds = %entry
+  %call = tail call fastcc i32 @nd_int()
+  %mul = mul nsw i32 %call, %x
+  %add = add nsw i32 %mul, 3
+  %call1 = tail call fastcc i32 @nd_int()
+  %xor = xor i32 %add, %call1
+  %call2 = tail call fastcc i32 @nd_int()
+  %mul3 = mul nsw i32 %call2, 5
+  %sub = sub nsw i32 %xor, %mul3
+  br label %sw.epilog
+
+sw.bb5:                                           ; preds = %entry
+  %add6 = add nsw i32 %x, 1
+  br label %sw.epilog
+
+sw.bb7:                                           ; preds = %entry
+  %mul8 = mul nsw i32 %x, 7
+  %call9 = tail call fastcc i32 @nd_int()
+  %sub10 = sub nsw i32 %mul8, %call9
+  %call11 = tail call fastcc i32 @nd_int()
+  %or = or i32 %sub10, %call11
+  %call12 = tail call fastcc i32 @nd_int()
+  %mul13 = mul nsw i32 %call12, 11
+  %add14 = add nsw i32 %or, %mul13
+  br label %sw.epilog
+
+sw.default:                                       ; preds = %entry
+  %call15 = tail call fastcc i32 @nd_int()
+  %or16 = or i32 %call15, 1
+  %div = sdiv i32 %x, %or16
+  %call17 = tail call fastcc i32 @nd_int()
+  %or18 = or i32 %call17, 1
+  %rem = srem i32 %div, %or18
+  %call19 = tail call fastcc i32 @nd_int()
+  %add20 = add nsw i32 %rem, %call19
+  br label %sw.epilog
+
+sw.epilog:                                        ; preds = %sw.default, %sw.bb7, %sw.bb5, %sw.bb
+  %r.0 = phi i32 [ %add20, %sw.default ], [ %add14, %sw.bb7 ], [ %add6, %sw.bb5 ], [ %sub, %sw.bb ]
+  ret i32 %r.0
+}
+
+; Function Attrs: noinline nounwind uwtable
+define internal fastcc i32 @report(i32 %tag, i32 %x) unnamed_addr #0 {
+entry:
+  %cmp6 = icmp sgt i32 %x, 0
+  br i1 %cmp6, label %for.body, label %for.end
+
+for.body:                                         ; preds = %entry, %for.body
+  %i.08 = phi i32 [ %add, %for.body ], [ 0, %entry ]
+  %sum.07 = phi i32 [ %add1, %for.body ], [ 0, %entry ]
+  %call = tail call fastcc i32 @nd_int()
+  %add = add nuw nsw i32 %i.08, 1
+  %rem = srem i32 %call, %add
+  %add1 = add nsw i32 %rem, %sum.07
+  %exitcond = icmp eq i32 %add, %x
+  br i1 %exitcond, label %for.end, label %for.body
+
+for.end:                                          ; preds = %for.body, %entry
+  %sum.0.lcssa = phi i32 [ 0, %entry ], [ %add1, %for.body ]
+  %call2 = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([15 x i8], [15 x i8]* @.str, i64 0, i64 0), i32 %tag, i32 %sum.0.lcssa)
+  ret i32 %sum.0.lcssa
+}
+
+declare i32 @printf(i8*, ...) local_unnamed_addr #2
+
+; Function Attrs: nounwind
+define i32 @main(i32, i8** nocapture readnone) local_unnamed_addr #3 {
+  %call.i = tail call fastcc i32 @nd_int() #3
+  %call1.i = tail call fastcc i32 @nd_int() #3
+  ; CHECK: "__occam_spec.compute(0x1,?)"
+  %call2.i = tail call fastcc i32 @"__occam_spec.compute(0x1,?)"(i32 %call.i) #3
+  %call3.i = tail call fastcc i32 @compute(i32 %call1.i, i32 %call.i) #3
+  ; CHECK: @report(i32 7
+  %call4.i = tail call fastcc i32 @report(i32 7, i32 %call.i) #3
+  %call5.i = tail call fastcc i32 @report(i32 %call1.i, i32 %call.i) #3
+  %call6.i = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([13 x i8], [13 x i8]* @.str.1, i64 0, i64 0), i32 %call2.i, i32 %call3.i, i32 %call4.i, i32 %call5.i) #3
+  ret i32 0
+}
+
+; Function Attrs: noinline nounwind uwtable
+define internal fastcc i32 @"__occam_spec.compute(0x1,?)"(i32 %x) unnamed_addr #0 {
+entry:
+  %add6 = add nsw i32 %x, 1
+  ret i32 %add6
+}
+
+attributes #0 = { noinline nounwind uwtable "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-jump-tables"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #1 = { nounwind "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #2 = { "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #3 = { nounwind }
+
+!llvm.ident = !{!0}
+!llvm.module.flags = !{!1}
+
+!0 = !{!"clang version 5.0.2 (tags/RELEASE_502/final)"}
+!1 = !{i32 1, !"wchar_size", i32 4}
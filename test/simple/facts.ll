@@ -0,0 +1,35 @@
+; RUN: cd %facts && %facts/build.sh
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck %s
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck --check-prefix=DEAD %s
+
+; The library always returns 0 from feature_enabled and defines the
+; constant lib_version: main folds both.
+; DEAD-NOT: the feature is enabled
+
+; ModuleID = 'slash/main-final.bc'
+source_filename = "llvm-link"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@.str.1 = private unnamed_addr constant [20 x i8] c"library version %d\0A\00", align 1
+
+declare i32 @feature_enabled() local_unnamed_addr #0
+
+declare i32 @printf(i8*, ...) local_unnamed_addr #0
+
+; Function Attrs: nounwind
+define i32 @main(i32, i8** nocapture readnone) local_unnamed_addr #1 {
+  %call = tail call i32 @feature_enabled() #1
+  ; CHECK: @printf({{.*}}, i32 42)
+  %call2 = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([20 x i8], [20 x i8]* @.str.1, i64 0, i64 0), i32 42) #1
+  ret i32 0
+}
+
+attributes #0 = { "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #1 = { nounwind }
+
+!llvm.ident = !{!0}
+!llvm.module.flags = !{!1}
+
+!0 = !{!"clang version 5.0.2 (tags/RELEASE_502/final)"}
+!1 = !{i32 1, !"wchar_size", i32 4}
@@ -0,0 +1,16 @@
+; RUN: cd %hashed_names && %hashed_names/build.sh
+; RUN: FileCheck %s < %hashed_names/clone.out.ll
+; RUN: FileCheck --check-prefix=HASHED %s < %hashed_names/clone-hashed.out.ll
+
+; Long names: the arguments are read back from the name, and no
+; metadata is attached.
+; CHECK: call i32 @"__occam_spec.f(0x1,0x7)"()
+; CHECK: define internal i32 @"__occam_spec.f(0x1,0x7)"()
+; CHECK-NOT: !occam.spec
+
+; Hashed names: the arguments are read back from the metadata, and
+; the new copy gets its own.
+; HASHED: call i32 @[[COPY:__occam_spec\.f\.[0-9a-fA-F]+]]()
+; HASHED-NOT: 0123456789ABCDEF
+; HASHED: define internal i32 @[[COPY]]() !occam.spec ![[KEY:[0-9]+]]
+; HASHED: ![[KEY]] = !{!"f", !"0x1", !"0x7"}
@@ -0,0 +1,21 @@
+; RUN: cd %iface_roundtrip && %iface_roundtrip/build.sh
+; RUN: head -c 8 %iface_roundtrip/main.flat | FileCheck --check-prefix=FLAT %s
+; RUN: diff %iface_roundtrip/main.txt %iface_roundtrip/main.roundtrip.txt
+; RUN: diff %iface_roundtrip/library.so.txt %iface_roundtrip/library.so.roundtrip.txt
+; RUN: FileCheck %s < %iface_roundtrip/main.roundtrip.txt
+
+; The interfaces survive protobuf -> flat -> protobuf unchanged: every
+; argument kind, the facts about the definitions, and the references.
+
+; FLAT: OCCAMFI1
+
+; CHECK: calls name: "libcall_double"
+; CHECK: calls name: "libcall_float"
+; CHECK: calls name: "libcall_global_pointer"
+; CHECK: calls name: "libcall_int"
+; CHECK: calls name: "libcall_int"
+; CHECK: calls name: "libcall_null_pointer"
+; CHECK: calls name: "libcall_string"
+; CHECK: calls name: "libcall_struct"
+; CHECK: definitions name: "main_version" value {
+; CHECK: globals name: "main_flags" value {
@@ -0,0 +1,10 @@
+; RUN: cd %persistent_sync && %persistent_sync/build.sh > %persistent_sync/sync.log
+; RUN: FileCheck %s < %persistent_sync/sync.log
+; RUN: %llvm_dis < %persistent_sync/main.0.bc | FileCheck --check-prefix=IR %s
+
+; Every sync of a module waits until it is on disk, and no answer of
+; the driver goes to the wrong thread.
+; CHECK-NOT: error:
+; CHECK: synced 200 of 200
+
+; IR: define i32 @main
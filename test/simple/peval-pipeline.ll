@@ -0,0 +1,44 @@
+; RUN: cd %peval_pipeline && %peval_pipeline/build.sh
+; RUN: %llvm_dis < %peval_pipeline/pipeline.bc | FileCheck %s
+; RUN: %llvm_dis < %peval_pipeline/separate.bc | FileCheck %s
+; RUN: diff %peval_pipeline/pipeline.defs %peval_pipeline/separate.defs
+
+; ModuleID = 'pipeline.bc'
+source_filename = "main.c"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@.str = private unnamed_addr constant [23 x i8] c"Fibonacci of %d is %d\0A\00", align 1
+
+; Function Attrs: noinline nounwind uwtable
+; CHECK: define i32 @main
+define i32 @main(i32, i8** nocapture readnone) local_unnamed_addr #0 {
+  %3 = icmp eq i32 %0, 2
+  br i1 %3, label %4, label %7
+
+; <label>:4:                                      ; preds = %2
+  %5 = tail call fastcc i32 @"__occam_spec.fibo(0xF)"()
+  %6 = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([23 x i8], [23 x i8]* @.str, i64 0, i64 0), i32 15, i32 %5)
+  br label %7
+
+; <label>:7:                                      ; preds = %4, %2
+  ret i32 0
+}
+
+declare i32 @printf(i8*, ...) local_unnamed_addr #1
+
+; Function Attrs: noinline norecurse nounwind readnone uwtable
+define internal fastcc i32 @"__occam_spec.fibo(0xF)"() unnamed_addr #2 {
+  ; CHECK: 610
+  ret i32 610
+}
+
+attributes #0 = { noinline nounwind uwtable "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-jump-tables"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #1 = { "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #2 = { noinline norecurse nounwind readnone uwtable "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-jump-tables"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+
+!llvm.ident = !{!0}
+!llvm.module.flags = !{!1}
+
+!0 = !{!"clang version 5.0.2 (tags/RELEASE_502/final)"}
+!1 = !{i32 1, !"wchar_size", i32 4}
@@ -0,0 +1,142 @@
+; RUN: cd %profile && %profile/build.sh
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck %s
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck --check-prefix=SITE1 %s
+
+; The profile (profile.txt) has the same caller and callee for both
+; calls: only their source locations tell them apart. The call on
+; line 20 always passes 2 and is specialized behind a guard. The call
+; on line 22 passes 6 and 7 as often and is not specialized on its
+; first argument.
+; SITE1-NOT: "__occam_spec.scale(0x6
+; SITE1-NOT: "__occam_spec.scale(0x7
+
+; ModuleID = 'slash/main-final.bc'
+source_filename = "llvm-link"
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@.str = private unnamed_addr constant [22 x i8] c"unexpected factor %d\0A\00", align 1
+@.str.1 = private unnamed_addr constant [7 x i8] c"%d %d\0A\00", align 1
+
+; Function Attrs: noinline nounwind uwtable
+define internal fastcc i32 @scale(i32 %factor, i32 %x) unnamed_addr #0 {
+entry:
+  switch i32 %factor, label %sw.default [
+    i32 2, label %sw.bb
+    i32 6, label %sw.bb1
+    i32 7, label %sw.bb2
+  ]
+
+sw.bb:                                            ; preds = %entry
+  %shl = shl i32 %x, 1
+  br label %return
+
+sw.bb1:                                           ; preds = %entry
+  %mul = mul nsw i32 %x, 6
+  br label %return
+
+sw.bb2:                                           ; preds = %entry
+  %mul3 = mul nsw i32 %x, 7
+  br label %return
+
+sw.default:                                       ; preds = %entry
+  %call = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([22 x i8], [22 x i8]* @.str, i64 0, i64 0), i32 %factor)
+  %mul4 = mul nsw i32 %factor, %x
+  br label %return
+
+return:                                           ; preds = %sw.default, %sw.bb2, %sw.bb1, %sw.bb
+  %retval.0 = phi i32 [ %mul4, %sw.default ], [ %mul3, %sw.bb2 ], [ %mul, %sw.bb1 ], [ %shl, %sw.bb ]
+  ret i32 %retval.0
+}
+
+declare i32 @printf(i8*, ...) local_unnamed_addr #1
+
+; Function Attrs: noinline nounwind uwtable
+define i32 @main(i32 %argc, i8** nocapture readnone %argv) local_unnamed_addr #0 {
+entry:
+  ; CHECK: icmp eq i32 %{{.*}}, 2
+  %0 = icmp eq i32 %argc, 2
+  br i1 %0, label %1, label %3
+
+; <label>:1:                                      ; preds = %entry
+  ; CHECK: "__occam_spec.scale(0x2,0xA)"
+  %2 = call fastcc i32 @"__occam_spec.scale(0x2,0xA)"()
+  br label %5
+
+; <label>:3:                                      ; preds = %entry
+  %4 = call fastcc i32 @"__occam_spec.scale(?,0xA)"(i32 %argc), !occam.fallback !2
+  br label %5
+
+; <label>:5:                                      ; preds = %3, %1
+  %a = phi i32 [ %2, %1 ], [ %4, %3 ]
+  %add = add nsw i32 %argc, 5
+  %call1 = tail call fastcc i32 @"__occam_spec.scale(?,0x14)"(i32 %add)
+  %call2 = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([7 x i8], [7 x i8]* @.str.1, i64 0, i64 0), i32 %a, i32 %call1)
+  ret i32 0
+}
+
+; Function Attrs: noinline nounwind uwtable
+define internal fastcc i32 @"__occam_spec.scale(0x2,0xA)"() unnamed_addr #0 {
+entry:
+  ret i32 20
+}
+
+; Function Attrs: noinline nounwind uwtable
+define internal fastcc i32 @"__occam_spec.scale(?,0xA)"(i32 %factor) unnamed_addr #0 {
+entry:
+  switch i32 %factor, label %sw.default [
+    i32 2, label %return
+    i32 6, label %sw.bb1
+    i32 7, label %sw.bb2
+  ]
+
+sw.bb1:                                           ; preds = %entry
+  br label %return
+
+sw.bb2:                                           ; preds = %entry
+  br label %return
+
+sw.default:                                       ; preds = %entry
+  %call = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([22 x i8], [22 x i8]* @.str, i64 0, i64 0), i32 %factor)
+  %mul4 = mul nsw i32 %factor, 10
+  br label %return
+
+return:                                           ; preds = %sw.default, %sw.bb2, %sw.bb1, %entry
+  %retval.0 = phi i32 [ %mul4, %sw.default ], [ 70, %sw.bb2 ], [ 60, %sw.bb1 ], [ 20, %entry ]
+  ret i32 %retval.0
+}
+
+; Function Attrs: noinline nounwind uwtable
+define internal fastcc i32 @"__occam_spec.scale(?,0x14)"(i32 %factor) unnamed_addr #0 {
+entry:
+  switch i32 %factor, label %sw.default [
+    i32 2, label %return
+    i32 6, label %sw.bb1
+    i32 7, label %sw.bb2
+  ]
+
+sw.bb1:                                           ; preds = %entry
+  br label %return
+
+sw.bb2:                                           ; preds = %entry
+  br label %return
+
+sw.default:                                       ; preds = %entry
+  %call = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([22 x i8], [22 x i8]* @.str, i64 0, i64 0), i32 %factor)
+  %mul4 = mul nsw i32 %factor, 20
+  br label %return
+
+return:                                           ; preds = %sw.default, %sw.bb2, %sw.bb1, %entry
+  %retval.0 = phi i32 [ %mul4, %sw.default ], [ 140, %sw.bb2 ], [ 120, %sw.bb1 ], [ 40, %entry ]
+  ret i32 %retval.0
+}
+
+attributes #0 = { noinline nounwind uwtable "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-jump-tables"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+attributes #1 = { "correctly-rounded-divide-sqrt-fp-math"="false" "disable-tail-calls"="false" "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "no-signed-zeros-fp-math"="false" "no-trapping-math"="false" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+fxsr,+mmx,+sse,+sse2,+x87" "unsafe-fp-math"="false" "use-soft-float"="false" }
+
+!llvm.ident = !{!0}
+!llvm.module.flags = !{!1}
+
+!0 = !{!"clang version 5.0.2 (tags/RELEASE_502/final)"}
+!1 = !{i32 1, !"wchar_size", i32 4}
+!2 = !{}
@@ -0,0 +1,13 @@
+; RUN: cd %recursive_budget && %recursive_budget/build.sh
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck %s
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck --check-prefix=BUDGET %s
+
+; Two copies of scaled on its varying argument: the second call on
+; (5, ?) reuses the first copy and is not charged. The invariant
+; argument is specialized regardless of the budget.
+; CHECK-DAG: define internal {{.*}}@"__occam_spec.scaled(0x5,?)"
+; CHECK-DAG: define internal {{.*}}@"__occam_spec.scaled(0x4,?)"
+; CHECK-DAG: define internal {{.*}}@"__occam_spec.scaled(?,0x3)"
+
+; The budget is spent: no third unfolding.
+; BUDGET-NOT: "__occam_spec.scaled(0x3,?)"
@@ -0,0 +1,12 @@
+; RUN: cd %rewrite_patterns && %rewrite_patterns/build.sh
+; RUN: %llvm_as < %rewrite_patterns/slash/main-final.ll | %llvm_dis | FileCheck %s
+
+; One callee, rewritten for several patterns of known and unknown
+; arguments. Each call goes to the most specific copy: (3,4) is not
+; taken by (3,?) or (?,4), and the call with no known argument is
+; kept.
+; CHECK-DAG: call {{.*}}@"__occam_spec.libcall(0x1,0x2)"()
+; CHECK-DAG: call {{.*}}@"__occam_spec.libcall(0x3,?)"(i32 %{{.*}})
+; CHECK-DAG: call {{.*}}@"__occam_spec.libcall(?,0x4)"(i32 %{{.*}})
+; CHECK-DAG: call {{.*}}@"__occam_spec.libcall(0x3,0x4)"()
+; CHECK-DAG: call {{.*}}@libcall(i32 %{{.*}}, i32 %{{.*}})
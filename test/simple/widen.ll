@@ -0,0 +1,12 @@
+; RUN: cd %widen && %widen/build.sh
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck %s
+; RUN: %llvm_as < slash/main-final.ll | %llvm_dis | FileCheck --check-prefix=WIDE %s
+
+; libcall has four distinct calls, over the limit of two: the varying
+; argument is widened and the calls share a single copy.
+; CHECK: "__occam_spec.libcall(?,0x7)"
+; WIDE-NOT: "__occam_spec.libcall(0x
+
+; othercall stays under the limit and keeps its specific copies.
+; CHECK-DAG: "__occam_spec.othercall(0x1,0x2)"
+; CHECK-DAG: "__occam_spec.othercall(0x3,0x4)"